@@ -0,0 +1,157 @@
+// Allocation benchmark and leak check: loads every scene in the data folder
+// a number of times in one process, renders each load once at a small size
+// and counts the heap allocations of the load and of the render, and the
+// bytes still allocated once the scene and renderer are gone. Those have to
+// come back to the same level after every load, a scene that leaves more
+// behind each time makes the exit status 1.
+//
+//   ./alloc_bench [<data-folder>] [number-of-loads]
+
+#include <new>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+
+#include <dirent.h>
+
+#include "Scene.h"
+#include "Renderer.h"
+
+#include <glm/glm.hpp>
+
+static const int IMAGE_HEIGHT = 90;
+
+// every allocation of the process goes through these, with its size kept
+// in front of the block
+static std::atomic<long long> numAllocations(0);
+static std::atomic<long long> liveBytes(0);
+
+static const size_t HEADER = 16;    // keeps the alignment of malloc
+
+void *operator new(size_t size) {
+    char *block = static_cast<char *>(std::malloc(size + HEADER));
+    if (!block)
+        throw std::bad_alloc();
+
+    *reinterpret_cast<size_t *>(block) = size;
+    numAllocations++;
+    liveBytes += static_cast<long long>(size);
+    return block + HEADER;
+}
+
+void operator delete(void *p) noexcept {
+    if (!p)
+        return;
+
+    char *block = static_cast<char *>(p) - HEADER;
+    liveBytes -= static_cast<long long>(*reinterpret_cast<size_t *>(block));
+    std::free(block);
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete[](void *p) noexcept {
+    operator delete(p);
+}
+
+struct Counts {
+    long long allocations;
+    long long bytes;
+};
+
+static Counts now() {
+    return Counts{ numAllocations.load(), liveBytes.load() };
+}
+
+static std::vector<std::string> listScenes(const std::string &folder) {
+    std::vector<std::string> names;
+    DIR *dir = opendir(folder.c_str());
+
+    if (dir) {
+        while (dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0)
+                names.push_back(name);
+        }
+        closedir(dir);
+    }
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+int main(int argc, char *argv[]) {
+    std::string dataFolder = argc > 1 ? argv[1] : "../data";
+    int numLoads = argc > 2 ? std::max(2, std::atoi(argv[2])) : 3;
+
+    std::vector<std::string> names = listScenes(dataFolder);
+    if (names.empty()) {
+        std::cerr << "No scenes found in " << dataFolder << std::endl;
+        return -1;
+    }
+
+    bool allPassed = true;
+
+    // only the calling thread, kept for every render as main keeps its pool
+    WorkerPool workers(1);
+
+    std::cout << std::left << std::setw(28) << "scene"
+              << std::right << std::setw(14) << "load allocs"
+              << std::setw(14) << "render allocs"
+              << std::setw(16) << "retained bytes" << std::endl;
+
+    for (const std::string &name : names) {
+        std::string path = dataFolder + "/" + name;
+        Counts load = {}, render = {};
+        std::vector<long long> retained;
+
+        for (int k = 0; k < numLoads; k++) {
+            Counts before = now();
+            {
+                Scene scene;
+                if (!scene.loadSceneFromJSON(path)) {
+                    std::cerr << "Failed to load " << path << std::endl;
+                    allPassed = false;
+                    break;
+                }
+
+                Counts loaded = now();
+
+                int width = static_cast<int>(scene.camera.getRatio() * IMAGE_HEIGHT);
+                std::vector<glm::vec4> pixels;
+                {
+                    Renderer renderer(scene, width, IMAGE_HEIGHT);
+                    renderer.render(pixels, workers);
+                }
+
+                Counts rendered = now();
+
+                load = Counts{ loaded.allocations - before.allocations, loaded.bytes - before.bytes };
+                render = Counts{ rendered.allocations - loaded.allocations, rendered.bytes - loaded.bytes };
+            }
+            retained.push_back(now().bytes - before.bytes);
+        }
+
+        // the first load may leave caches of the renderer behind (per
+        // thread scratch), later ones must not add to them
+        bool leaks = false;
+        for (size_t k = 1; k < retained.size(); k++)
+            leaks = leaks || retained[k] != 0;
+
+        allPassed = allPassed && !leaks;
+
+        std::cout << std::left << std::setw(28) << name
+                  << std::right << std::setw(14) << load.allocations
+                  << std::setw(14) << render.allocations
+                  << std::setw(16) << (retained.empty() ? 0 : retained.back())
+                  << (leaks ? "  LEAKS" : "") << std::endl;
+    }
+
+    return allPassed ? 0 : 1;
+}
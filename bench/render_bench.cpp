@@ -0,0 +1,395 @@
+// Render benchmark and regression check: renders every scene in the data
+// folder and a few larger synthetic ones at a fixed resolution, and prints
+// a JSON report with the load and render times, the primary, shadow and
+// reflection rays per second, the peak memory and the PSNR of each image
+// against the reference of the same name in the results folder. Scenes
+// below the PSNR tolerance are written to the current folder and make the
+// exit status 1.
+//
+//   ./render_bench [<data-folder>] [<results-folder>] [number-of-threads] [min-PSNR]
+
+#include <cmath>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <algorithm>
+#include <functional>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <dirent.h>
+#include <sys/resource.h>
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+#include "utils.h"
+
+#include "Scene.h"
+#include "Renderer.h"
+
+#include <glm/glm.hpp>
+
+static const int IMAGE_HEIGHT = 720;
+// images are compared in 8 bits, identical ones are reported at this PSNR
+static const double PSNR_IDENTICAL = 100.0;
+static const double DEFAULT_MIN_PSNR = 40.0;
+
+struct BenchScene {
+    std::string name;
+    std::string source;                     // "data" or "synthetic"
+    std::function<bool(Scene &)> load;
+};
+
+struct BenchResult {
+    std::string name;
+    std::string source;
+    int width;
+    int height;
+    double loadSeconds;
+    double renderSeconds;
+    RayCounts rays;
+    long long peakMemoryKB;
+    bool hasReference;
+    double mse;
+    double psnr;
+    bool passed;
+};
+
+// the .json files of folder, sorted by name
+static std::vector<std::string> listScenes(const std::string &folder) {
+    std::vector<std::string> names;
+
+#ifdef _WIN32
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA((folder + "/*.json").c_str(), &entry);
+
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            names.push_back(entry.cFileName);
+        } while (FindNextFileA(find, &entry));
+        FindClose(find);
+    }
+#else
+    DIR *dir = opendir(folder.c_str());
+
+    if (dir) {
+        while (dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() > 5 && name.compare(name.size() - 5, 5, ".json") == 0)
+                names.push_back(name);
+        }
+        closedir(dir);
+    }
+#endif
+
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+// high-water mark of the process so far, in KB
+static long long peakMemoryKB() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS info;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &info, sizeof(info)))
+        return -1;
+    return static_cast<long long>(info.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#ifdef __APPLE__
+    return static_cast<long long>(usage.ru_maxrss / 1024);  // bytes there
+#else
+    return static_cast<long long>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+static Light makeLight(LightType type, const glm::vec3 &v, const glm::vec3 &color) {
+    // the same split of a color as Scene::loadSceneFromJSON
+    return Light(type, v, 0.2f * color, color, glm::vec3(1.0f));
+}
+
+// the camera of the data scenes, moved to eye. Camera3D hands the
+// normalized "look" to glm::lookAt as the point to look at, so it looks
+// from eye towards (0, 0, -1)
+static void setCamera(Scene &scene, const glm::vec3 &eye) {
+    float focalLength = 3.0f;
+    float height = 1.0f;
+    float width = 16.0f / 9.0f;
+
+    scene.camera.update(focalLength, 2.0f * std::atan2(0.5f * height, focalLength), width / height,
+                        eye, glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, -1.0f));
+}
+
+// n x n spheres of alternating materials on a mirror plane
+static bool makeSphereGrid(Scene &scene, int n) {
+    setCamera(scene, glm::vec3(0.0f, 1.5f, 12.0f));
+
+    scene.materials.add(Material(1000.0f, glm::vec3(1.0f, 0.7f, 0.2f), glm::vec3(1.0f, 0.7f, 0.2f),
+                                 glm::vec3(0.8f), glm::vec3(0.05f)));
+    scene.materials.add(Material(1000.0f, glm::vec3(0.2f, 1.0f, 0.7f), glm::vec3(0.2f, 1.0f, 0.7f),
+                                 glm::vec3(0.8f), glm::vec3(0.3f)));
+    scene.materials.add(Material(20.0f, glm::vec3(0.2f, 0.3f, 0.8f), glm::vec3(0.2f, 0.3f, 0.8f),
+                                 glm::vec3(0.1f), glm::vec3(0.3f)));
+
+    scene.lights.push_back(makeLight(LightType::Directional, glm::vec3(-0.3f, -1.0f, -0.5f), glm::vec3(0.6f)));
+    scene.lights.push_back(makeLight(LightType::Point, glm::vec3(-10.0f, 20.0f, 10.0f), glm::vec3(0.6f)));
+
+    float spacing = 20.0f / n;
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            glm::vec3 center(-10.0f + (i + 0.5f) * spacing, 0.4f * spacing, -2.0f - (j + 0.5f) * spacing);
+            scene.addSphere(center, 0.4f * spacing, (i + j) % 2);
+        }
+    }
+
+    scene.addPlane(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 2);
+    scene.buildAccelerationStructure();
+    return true;
+}
+
+// a row of matte spheres on a matte plane, lit by n x n dim point lights
+// that make up an area light. It comes after scenes with one or two
+// lights, so the run is also a batch that mixes few and many lights in one
+// process, as the renderer does with several scene files
+static bool makeManyLights(Scene &scene, int n) {
+    setCamera(scene, glm::vec3(0.0f, 1.5f, 12.0f));
+
+    scene.materials.add(Material(10.0f, glm::vec3(0.9f, 0.4f, 0.2f), glm::vec3(0.9f, 0.4f, 0.2f),
+                                 glm::vec3(0.0f), glm::vec3(0.0f)));
+    scene.materials.add(Material(10.0f, glm::vec3(0.6f), glm::vec3(0.6f), glm::vec3(0.0f), glm::vec3(0.0f)));
+
+    for (int i = 0; i < 5; i++)
+        scene.addSphere(glm::vec3(-6.0f + 3.0f * i, 1.0f, -4.0f), 1.0f, 0);
+
+    scene.addPlane(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 1);
+
+    // 4 x 4 units above and right of the spheres
+    glm::vec3 color(1.5f / (n * n));
+    float spacing = 4.0f / n;
+
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            glm::vec3 position(4.0f + (i + 0.5f) * spacing, 10.0f, -(j + 0.5f) * spacing);
+            scene.lights.push_back(makeLight(LightType::Point, position, color));
+        }
+    }
+
+    scene.buildAccelerationStructure();
+    return true;
+}
+
+// a rippled height field of 2 n^2 triangles
+static bool makeTerrain(Scene &scene, int n) {
+    setCamera(scene, glm::vec3(0.0f, 2.0f, 10.0f));
+
+    scene.materials.add(Material(100.0f, glm::vec3(0.3f, 0.6f, 0.3f), glm::vec3(0.3f, 0.6f, 0.3f),
+                                 glm::vec3(0.3f), glm::vec3(0.1f)));
+
+    scene.lights.push_back(makeLight(LightType::Point, glm::vec3(5.0f, 10.0f, 5.0f), glm::vec3(0.8f)));
+
+    // wound so that the triangle normals point up
+    auto vertex = [n](int i, int j) {
+        float x = -10.0f + 20.0f * i / n;
+        float z = 8.0f - 28.0f * j / n;
+        return glm::vec3(x, 0.5f * std::sin(x) * std::cos(0.7f * z), z);
+    };
+
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            scene.addTriangle(vertex(i, j), vertex(i + 1, j + 1), vertex(i + 1, j), 0);
+            scene.addTriangle(vertex(i, j), vertex(i, j + 1), vertex(i + 1, j + 1), 0);
+        }
+    }
+
+    scene.buildAccelerationStructure();
+    return true;
+}
+
+// mean squared error and PSNR of image against the PNG at path, false if
+// it cannot be read or has another size
+static bool compareImage(const std::vector<unsigned char> &image, int width, int height,
+                         const std::string &path, double &mse, double &psnr) {
+    int w, h, comp;
+    stbi_uc *reference = stbi_load(path.c_str(), &w, &h, &comp, 4);
+
+    if (!reference)
+        return false;
+
+    if (w != width || h != height) {
+        stbi_image_free(reference);
+        return false;
+    }
+
+    double sum = 0.0;
+    for (size_t k = 0; k < static_cast<size_t>(width) * height; k++) {
+        for (int c = 0; c < 3; c++) {
+            double diff = static_cast<double>(image[4 * k + c]) - reference[4 * k + c];
+            sum += diff * diff;
+        }
+    }
+    stbi_image_free(reference);
+
+    mse = sum / (3.0 * width * height);
+    psnr = mse > 0.0 ? std::min(PSNR_IDENTICAL, 10.0 * std::log10(255.0 * 255.0 / mse)) : PSNR_IDENTICAL;
+    return true;
+}
+
+static std::vector<unsigned char> toBytes(const std::vector<glm::vec4> &pixels) {
+    std::vector<unsigned char> bytes(4 * pixels.size());
+
+    for (size_t k = 0; k < pixels.size(); k++) {
+        for (int c = 0; c < 4; c++)
+            bytes[4 * k + c] = floatToUnsignedChar(pixels[k][c]);
+    }
+
+    return bytes;
+}
+
+static double perSecond(long long count, double seconds) {
+    return seconds > 0.0 ? count / seconds : 0.0;
+}
+
+static void printResult(const BenchResult &r, bool last) {
+    std::cout << "    {\n"
+              << "      \"name\": \"" << r.name << "\",\n"
+              << "      \"source\": \"" << r.source << "\",\n"
+              << "      \"width\": " << r.width << ",\n"
+              << "      \"height\": " << r.height << ",\n"
+              << "      \"loadSeconds\": " << r.loadSeconds << ",\n"
+              << "      \"renderSeconds\": " << r.renderSeconds << ",\n"
+              << "      \"primaryRays\": " << r.rays.primary << ",\n"
+              << "      \"shadowRays\": " << r.rays.shadow << ",\n"
+              << "      \"reflectionRays\": " << r.rays.reflection << ",\n"
+              << "      \"primaryRaysPerSecond\": " << perSecond(r.rays.primary, r.renderSeconds) << ",\n"
+              << "      \"shadowRaysPerSecond\": " << perSecond(r.rays.shadow, r.renderSeconds) << ",\n"
+              << "      \"reflectionRaysPerSecond\": " << perSecond(r.rays.reflection, r.renderSeconds) << ",\n"
+              << "      \"peakMemoryKB\": " << r.peakMemoryKB << ",\n";
+
+    if (r.hasReference) {
+        std::cout << "      \"mse\": " << r.mse << ",\n"
+                  << "      \"psnr\": " << r.psnr << ",\n";
+    } else {
+        std::cout << "      \"mse\": null,\n"
+                  << "      \"psnr\": null,\n";
+    }
+
+    std::cout << "      \"passed\": " << (r.passed ? "true" : "false") << "\n"
+              << "    }" << (last ? "" : ",") << "\n";
+}
+
+int main(int argc, char *argv[]) {
+    std::string dataFolder = argc > 1 ? argv[1] : "../data";
+    std::string resultsFolder = argc > 2 ? argv[2] : "../results";
+    int numThreads = argc > 3 ? std::max(1, std::atoi(argv[3])) : std::max(1u, std::thread::hardware_concurrency());
+    double minPsnr = argc > 4 ? std::atof(argv[4]) : DEFAULT_MIN_PSNR;
+
+    std::vector<BenchScene> scenes;
+
+    for (const std::string &file : listScenes(dataFolder)) {
+        std::string path = dataFolder + "/" + file;
+        scenes.push_back(BenchScene{ file.substr(0, file.size() - 5), "data", [path](Scene &scene) {
+            return scene.loadSceneFromJSON(path);
+        }});
+    }
+
+    if (scenes.empty())
+        std::cerr << "No scenes found in " << dataFolder << std::endl;
+
+    scenes.push_back(BenchScene{ "synthetic-sphere-grid", "synthetic", [](Scene &scene) {
+        return makeSphereGrid(scene, 100);
+    }});
+    scenes.push_back(BenchScene{ "synthetic-terrain", "synthetic", [](Scene &scene) {
+        return makeTerrain(scene, 400);
+    }});
+    scenes.push_back(BenchScene{ "synthetic-many-lights", "synthetic", [](Scene &scene) {
+        return makeManyLights(scene, 4);
+    }});
+
+    std::vector<BenchResult> results;
+    bool allPassed = true;
+
+    WorkerPool workers(numThreads);
+
+    for (const BenchScene &benchScene : scenes) {
+        BenchResult r = {};
+        r.name = benchScene.name;
+        r.source = benchScene.source;
+
+        Scene scene;
+        auto start = std::chrono::steady_clock::now();
+
+        if (!benchScene.load(scene)) {
+            std::cerr << "Failed to load scene " << benchScene.name << std::endl;
+            allPassed = false;
+            continue;
+        }
+
+        auto loaded = std::chrono::steady_clock::now();
+
+        r.height = IMAGE_HEIGHT;
+        r.width = static_cast<int>(scene.camera.getRatio() * IMAGE_HEIGHT);
+
+        Renderer renderer(scene, r.width, r.height);
+        std::vector<glm::vec4> pixels;
+        renderer.render(pixels, workers);
+
+        auto rendered = std::chrono::steady_clock::now();
+
+        r.loadSeconds = std::chrono::duration<double>(loaded - start).count();
+        r.renderSeconds = std::chrono::duration<double>(rendered - loaded).count();
+        r.rays = renderer.rayCounts();
+        r.peakMemoryKB = peakMemoryKB();
+
+        // scenes without a reference image only report their timings
+        std::string reference = resultsFolder + "/" + benchScene.name + ".png";
+
+        r.hasReference = std::ifstream(reference).good();
+        r.passed = true;
+
+        if (r.hasReference) {
+            if (!compareImage(toBytes(pixels), r.width, r.height, reference, r.mse, r.psnr)) {
+                std::cerr << "Cannot compare against " << reference << std::endl;
+                r.mse = 0.0;
+                r.psnr = 0.0;
+            }
+
+            r.passed = r.psnr >= minPsnr;
+        }
+
+        if (!r.passed) {
+            write_matrix_to_png(pixels, r.height, r.width, benchScene.name + ".png");
+            allPassed = false;
+        }
+
+        results.push_back(r);
+    }
+
+    std::cout << std::setprecision(6)
+              << "{\n"
+              << "  \"threads\": " << numThreads << ",\n"
+              << "  \"minPsnr\": " << minPsnr << ",\n"
+              << "  \"scenes\": [\n";
+
+    for (size_t k = 0; k < results.size(); k++)
+        printResult(results[k], k + 1 == results.size());
+
+    std::cout << "  ],\n"
+              << "  \"passed\": " << (allPassed ? "true" : "false") << "\n"
+              << "}" << std::endl;
+
+    return allPassed ? 0 : 1;
+}
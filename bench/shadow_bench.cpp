@@ -0,0 +1,212 @@
+// Shadow ray benchmark: Renderer::occluded (any hit, with and without the
+// last occluder cache) against the nearest-hit test it replaced, on the
+// shadow rays of the primary hits of a scene. Also counts the shadow and
+// reflection rays of those hits that hit the surface they leave from, with
+// the origin not moved, moved by a fixed 1e-4 along the normal (what the
+// renderer used to do) and placed by offsetRayOrigin.
+//
+//   ./shadow_bench [<path-to-JSON-file>] [number-of-passes]
+
+#include <ctime>
+#include <limits>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+
+#include "Scene.h"
+#include "Renderer.h"
+
+#include <glm/glm.hpp>
+
+static const int WIDTH = 640;
+static const int HEIGHT = 360;
+static const float EPSILON = 1e-4f;
+
+struct ShadowRay {
+    glm::vec3 e;
+    glm::vec3 d;
+    float tMax;
+    int light;
+    int id;     // the object (and triangle of a mesh) the ray leaves from
+    int prim;
+};
+
+typedef glm::vec3 (*OriginOffset)(const glm::vec3 &hit, const glm::vec3 &n, const glm::vec3 &error, const glm::vec3 &w);
+
+static glm::vec3 noOffset(const glm::vec3 &hit, const glm::vec3 &, const glm::vec3 &, const glm::vec3 &) {
+    return hit;
+}
+
+static glm::vec3 fixedOffset(const glm::vec3 &hit, const glm::vec3 &n, const glm::vec3 &, const glm::vec3 &) {
+    return hit + EPSILON * n;
+}
+
+// the previous Renderer::findIntersections, kept as the reference: every
+// candidate goes through the nearest-hit test of its object
+static bool occludedNearest(const Scene &scene, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) {
+    auto test = [&](int k, float &) {
+        float this_t;
+        int this_prim;
+        bool this_bool = scene.intersect(k, e, d, t0, this_t, this_prim);
+
+        return this_bool && this_t < t1;
+    };
+
+    float tMax = t1;
+    for (int k = 0; k < static_cast<int>(scene.unbounded.size()); k++) {
+        if (test(scene.unbounded[k], tMax))
+            return true;
+    }
+
+    return scene.bvh.traverse(e, d, t0, t1, test);
+}
+
+// the shadow rays Renderer::shade casts from the primary hits, and the
+// reflection rays (tMax infinite, light -1) when reflections is given
+static std::vector<ShadowRay> makeShadowRays(Scene &scene, const Renderer &renderer, OriginOffset offset,
+                                             std::vector<ShadowRay> *reflections = nullptr) {
+    std::vector<ShadowRay> rays;
+    glm::vec3 eye = scene.camera.getPosition();
+    float focalLength = scene.camera.getFocalLength();
+
+    for (int j = 0; j < HEIGHT; j++) {
+        for (int i = 0; i < WIDTH; i++) {
+            glm::vec3 d = renderer.primaryRay(i, j);
+            HitRecord rec;
+
+            if (!renderer.findNearestIntersection(eye, d, focalLength, std::numeric_limits<float>::infinity(), rec))
+                continue;
+
+            glm::vec3 hit = eye + rec.t * d;
+
+            for (int k = 0; k < static_cast<int>(scene.lights.size()); k++) {
+                const Light &light = scene.lights[k];
+                ShadowRay ray;
+
+                ray.light = k;
+                ray.id = rec.idx;
+                ray.prim = rec.prim;
+
+                if (light.type == LightType::Point) {
+                    ray.d = glm::normalize(light.position - hit);
+                    ray.tMax = glm::length(light.position - hit);
+                } else {
+                    ray.d = glm::normalize(-1.0f * light.direction);
+                    ray.tMax = std::numeric_limits<float>::infinity();
+                }
+
+                // lights behind the surface are not traced
+                if (glm::dot(rec.n, ray.d) > 0.0f) {
+                    ray.e = offset(hit, rec.n, rec.error, ray.d);
+                    rays.push_back(ray);
+                }
+            }
+
+            if (reflections) {
+                glm::vec3 r = glm::reflect(d, rec.n);
+                reflections->push_back(ShadowRay{ offset(hit, rec.n, rec.error, r), r, std::numeric_limits<float>::infinity(),
+                                                  -1, rec.idx, rec.prim });
+            }
+        }
+    }
+
+    return rays;
+}
+
+// rays that hit the surface they leave from. Nothing a ray leaves can be
+// hit again by it (spheres are convex, a mesh only counts the same
+// triangle), so every one of them is a wrong shadow or reflection
+static int countSelfHits(const Scene &scene, const std::vector<ShadowRay> &rays) {
+    int count = 0;
+
+    for (const ShadowRay &ray : rays)
+        count += scene.occludedBy(ray.id, ray.prim, ray.e, ray.d, 0.0f, ray.tMax);
+
+    return count;
+}
+
+// Mrays/s of the fastest of numPasses replays of rays (the others are
+// mostly disturbed by whatever else runs), blocked gets the answer per ray
+template <typename Query>
+static double run(const std::vector<ShadowRay> &rays, int numPasses, std::vector<char> &blocked, Query query) {
+    blocked.assign(rays.size(), 0);
+    double best = std::numeric_limits<double>::infinity();
+
+    for (int pass = 0; pass < numPasses; pass++) {
+        std::clock_t start = std::clock();
+
+        for (unsigned r = 0; r < rays.size(); r++)
+            blocked[r] = query(rays[r]);
+
+        std::clock_t stop = std::clock();
+        best = std::min(best, static_cast<double>(stop - start) / CLOCKS_PER_SEC);
+    }
+
+    return rays.size() / best * 1e-6;
+}
+
+int main(int argc, char *argv[]) {
+    std::string jsonPath = argc > 1 ? argv[1] : "../data/example-scene.json";
+    int numPasses = argc > 2 ? std::max(1, std::atoi(argv[2])) : 5;
+
+    Scene scene;
+    if (!scene.loadSceneFromJSON(jsonPath)) {
+        std::cerr << "Failed to load scene from JSON" << std::endl;
+        return -1;
+    }
+
+    Renderer renderer(scene, WIDTH, HEIGHT);
+    std::vector<ShadowRay> reflections;
+    std::vector<ShadowRay> rays = makeShadowRays(scene, renderer, offsetRayOrigin, &reflections);
+
+    if (rays.empty()) {
+        std::cerr << "No shadow rays, nothing is hit or there are no lights" << std::endl;
+        return -1;
+    }
+
+    std::vector<char> nearest, anyHit, cached;
+
+    double mraysNearest = run(rays, numPasses, nearest, [&](const ShadowRay &ray) {
+        return occludedNearest(scene, ray.e, ray.d, 0.0f, ray.tMax);
+    });
+    double mraysAnyHit = run(rays, numPasses, anyHit, [&](const ShadowRay &ray) {
+        return renderer.occluded(ray.e, ray.d, 0.0f, ray.tMax);
+    });
+    double mraysCached = run(rays, numPasses, cached, [&](const ShadowRay &ray) {
+        return renderer.occluded(ray.e, ray.d, 0.0f, ray.tMax, ray.light);
+    });
+
+    int numBlocked = 0, mismatches = 0;
+    for (unsigned r = 0; r < rays.size(); r++) {
+        numBlocked += nearest[r];
+        mismatches += nearest[r] != anyHit[r] || nearest[r] != cached[r];
+    }
+
+    std::cout << "Shadow rays of " << jsonPath << ", " << rays.size() << " rays x "
+              << numPasses << " passes, " << numBlocked << " blocked" << std::endl;
+    std::cout << "  nearest hit        : " << mraysNearest << " Mrays/s" << std::endl;
+    std::cout << "  any hit            : " << mraysAnyHit << " Mrays/s" << std::endl;
+    std::cout << "  any hit + cache    : " << mraysCached << " Mrays/s" << std::endl;
+    std::cout << "  speedup            : " << mraysCached / mraysNearest << "x" << std::endl;
+    std::cout << "  disagreements      : " << mismatches << std::endl;
+
+    const char *names[] = { "no offset", "1e-4 along normal", "offsetRayOrigin" };
+    OriginOffset offsets[] = { noOffset, fixedOffset, offsetRayOrigin };
+
+    std::cout << "Self-hits of " << rays.size() << " shadow and " << reflections.size()
+              << " reflection rays" << std::endl;
+
+    for (int k = 0; k < 3; k++) {
+        std::vector<ShadowRay> offsetReflections;
+        std::vector<ShadowRay> offsetRays = makeShadowRays(scene, renderer, offsets[k], &offsetReflections);
+
+        std::cout << "  " << std::left << std::setw(19) << names[k] << ": "
+                  << countSelfHits(scene, offsetRays) << " shadow, "
+                  << countSelfHits(scene, offsetReflections) << " reflection" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,179 @@
+// Micro benchmark: the precomputed Moller-Trumbore kernel in
+// TriangleArray::intersect against the Cramer's-rule kernel it replaced.
+//
+//   ./triangle_bench [number-of-tests]
+
+#include <cmath>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+#include "Primitives.h"
+
+#include <glm/glm.hpp>
+
+// the test triangles, as vertices for the reference and precomputed
+struct TestTriangles {
+    std::vector<glm::vec3> a, b, c;
+    TriangleArray precomputed;
+};
+
+// the previous Triangle::intersectRay, kept verbatim as the reference
+static bool intersectCramer(const TestTriangles &tris, int i, const glm::vec3 &e, const glm::vec3 &d, float &t, glm::vec3 &n) {
+    const glm::vec3 &a = tris.a[i];
+    const glm::vec3 &b = tris.b[i];
+    const glm::vec3 &c = tris.c[i];
+
+    float xa = a.x, ya = a.y, za = a.z;
+    float xb = b.x, yb = b.y, zb = b.z;
+    float xc = c.x, yc = c.y, zc = c.z;
+    float xd = d.x, yd = d.y, zd = d.z;
+    float xe = e.x, ye = e.y, ze = e.z;
+
+    glm::mat3 A = {
+        xa-xb, xa-xc, xd,
+        ya-yb, ya-yc, yd,
+        za-zb, za-zc, zd
+    };
+
+    glm::mat3 M1 = {
+        xa-xb, xa-xc, xa-xe,
+        ya-yb, ya-yc, ya-ye,
+        za-zb, za-zc, za-ze
+    };
+
+    t = glm::determinant(M1)/glm::determinant(A);
+    if (std::isnan(t) || t == -INFINITY || t == INFINITY)
+        return false;
+
+    glm::mat3 M2 = {
+        xa-xb, xa-xe, xd,
+        ya-yb, ya-ye, yd,
+        za-zb, za-ze, zd
+    };
+
+    float gamma = glm::determinant(M2)/glm::determinant(A);
+
+    if (gamma < 0.0f || gamma > 1.0f)
+        return false;
+
+    glm::mat3 M3 = {
+        xa-xe, xa-xc, xd,
+        ya-ye, ya-yc, yd,
+        za-ze, za-zc, zd
+    };
+
+    float beta = glm::determinant(M3)/glm::determinant(A);
+
+    if (beta < 0.0f || beta > 1.0f-gamma)
+        return false;
+
+    n = glm::normalize(glm::cross(c-a, b-a));
+
+    return true;
+}
+
+static bool intersectMollerTrumbore(const TestTriangles &tris, int i, const glm::vec3 &e, const glm::vec3 &d, float &t, glm::vec3 &n) {
+    // along the whole line, as the reference
+    if (!tris.precomputed.intersect(i, e, d, -std::numeric_limits<float>::infinity(), t))
+        return false;
+
+    n = tris.precomputed.normal(i);
+    return true;
+}
+
+typedef bool (*Kernel)(const TestTriangles&, int, const glm::vec3&, const glm::vec3&, float&, glm::vec3&);
+
+struct Ray {
+    glm::vec3 e;
+    glm::vec3 d;
+};
+
+// both kernels are called through a volatile function pointer, so neither
+// gets inlined into the loop. The working set stays in cache, the rays are
+// replayed numPasses times
+static double run(Kernel volatile kernel,
+                  const TestTriangles &triangles,
+                  const std::vector<Ray> &rays,
+                  int numPasses,
+                  std::vector<float> &hits) {
+    hits.assign(rays.size(), NAN);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    for (int pass = 0; pass < numPasses; pass++) {
+        for (unsigned r = 0, k = 0; r < rays.size(); r++) {
+            float t;
+            glm::vec3 n;
+
+            if (kernel(triangles, k, rays[r].e, rays[r].d, t, n))
+                hits[r] = t + n.x;
+
+            if (++k == triangles.a.size())
+                k = 0;
+        }
+    }
+
+    auto stop = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration<double, std::nano>(stop - start).count() / (rays.size() * numPasses);
+}
+
+int main(int argc, char *argv[]) {
+    int numTests = argc > 1 ? std::atoi(argv[1]) : 16000000;
+    int numRays = 16384;
+    int numPasses = std::max(1, numTests / numRays);
+
+    std::mt19937 rng(6533);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    TestTriangles triangles;
+    for (int i = 0; i < 4096; i++) {
+        glm::vec3 center(unit(rng), unit(rng), unit(rng));
+        triangles.a.push_back(center + 0.3f * glm::vec3(unit(rng), unit(rng), unit(rng)));
+        triangles.b.push_back(center + 0.3f * glm::vec3(unit(rng), unit(rng), unit(rng)));
+        triangles.c.push_back(center + 0.3f * glm::vec3(unit(rng), unit(rng), unit(rng)));
+        triangles.precomputed.add(triangles.a[i], triangles.b[i], triangles.c[i]);
+    }
+
+    // rays from a sphere around the triangles aimed at the triangle they are
+    // tested against, jittered so that roughly half of them miss
+    std::vector<Ray> rays(numRays);
+    for (int r = 0; r < numRays; r++) {
+        int k = r % triangles.a.size();
+        glm::vec3 target = (triangles.a[k] + triangles.b[k] + triangles.c[k]) / 3.0f + 0.2f * glm::vec3(unit(rng), unit(rng), unit(rng));
+
+        rays[r].e = 5.0f * glm::normalize(glm::vec3(unit(rng), unit(rng), unit(rng)));
+        rays[r].d = glm::normalize(target - rays[r].e);
+    }
+
+    std::vector<float> hitsCramer, hitsMT;
+
+    // warm up, then measure
+    run(intersectCramer, triangles, rays, 1, hitsCramer);
+    double nsCramer = run(intersectCramer, triangles, rays, numPasses, hitsCramer);
+    double nsMT = run(intersectMollerTrumbore, triangles, rays, numPasses, hitsMT);
+
+    int numHits = 0, mismatches = 0;
+    for (int r = 0; r < numRays; r++) {
+        bool hitCramer = !std::isnan(hitsCramer[r]);
+        bool hitMT = !std::isnan(hitsMT[r]);
+
+        numHits += hitMT;
+
+        if (hitCramer != hitMT || (hitMT && std::fabs(hitsCramer[r] - hitsMT[r]) > 1e-4f))
+            mismatches++;
+    }
+
+    std::cout << "Triangle intersection, " << numRays * numPasses << " tests, "
+              << numHits << "/" << numRays << " rays hit" << std::endl;
+    std::cout << "  Cramer's rule    : " << nsCramer << " ns/test" << std::endl;
+    std::cout << "  Moller-Trumbore  : " << nsMT << " ns/test" << std::endl;
+    std::cout << "  speedup          : " << nsCramer / nsMT << "x" << std::endl;
+    std::cout << "  disagreements    : " << mismatches << std::endl;
+
+    return 0;
+}
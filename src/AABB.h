@@ -0,0 +1,79 @@
+#pragma once
+
+#include <limits>
+#include <algorithm>
+
+#include <glm/glm.hpp>
+
+// axis-aligned bounding box, empty (inverted) by default
+struct AABB {
+    glm::vec3 min;
+    glm::vec3 max;
+
+    AABB()
+            : min{ std::numeric_limits<float>::infinity()}
+            , max{-std::numeric_limits<float>::infinity()} {}
+
+    AABB(const glm::vec3 &a, const glm::vec3 &b)
+            : min{a}
+            , max{b} {}
+
+    void expand(const glm::vec3 &p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void expand(const AABB &box) {
+        min = glm::min(min, box.min);
+        max = glm::max(max, box.max);
+    }
+
+    bool empty() const {
+        return min.x > max.x || min.y > max.y || min.z > max.z;
+    }
+
+    glm::vec3 centroid() const {
+        return 0.5f * (min + max);
+    }
+
+    float surfaceArea() const {
+        if (empty())
+            return 0.0f;
+
+        glm::vec3 ext = max - min;
+        return 2.0f * (ext.x * ext.y + ext.y * ext.z + ext.z * ext.x);
+    }
+
+    int longestAxis() const {
+        glm::vec3 ext = max - min;
+
+        if (ext.x > ext.y && ext.x > ext.z)
+            return 0;
+
+        return ext.y > ext.z ? 1 : 2;
+    }
+
+    // slab test against the parametric range [t0, t1], invD is 1/d per component.
+    // tFar is scaled up slightly (see PBRT 3.9.2) so that a hit point computed
+    // by an object's own intersection routine is never culled by its box.
+    bool intersectRay(const glm::vec3 &e, const glm::vec3 &invD, float t0, float t1) const {
+        for (int a = 0; a < 3; a++) {
+            float tNear = (min[a] - e[a]) * invD[a];
+            float tFar  = (max[a] - e[a]) * invD[a];
+
+            if (tNear > tFar)
+                std::swap(tNear, tFar);
+
+            tFar *= 1.0f + 2.0f * 3.0f * std::numeric_limits<float>::epsilon();
+
+            // written so that NaN (0 * inf) never rejects the box
+            t0 = tNear > t0 ? tNear : t0;
+            t1 = tFar < t1 ? tFar : t1;
+
+            if (t0 > t1)
+                return false;
+        }
+
+        return true;
+    }
+};
@@ -0,0 +1,240 @@
+#include "BVH.h"
+
+#include <algorithm>
+
+static const int BVH_NUM_BINS = 12;
+static const int BVH_MAX_LEAF_SIZE = 4;
+static const float BVH_TRAVERSAL_COST = 0.125f;
+// past this depth we fall back to median splits, keeps the traversal stack bounded
+static const int BVH_MAX_SAH_DEPTH = 48;
+
+struct BuildPrimitive {
+    AABB bounds;
+    glm::vec3 centroid;
+    int id;
+};
+
+struct BuildBin {
+    AABB bounds;
+    int count;
+
+    BuildBin(): count{0} {}
+};
+
+static int makeLeaf(std::vector<BVHNode> &nodes, const AABB &bounds, int begin, int end) {
+    BVHNode leaf;
+    leaf.bounds = bounds;
+    leaf.offset = begin;
+    leaf.count = static_cast<unsigned short>(end - begin);
+    leaf.axis = 0;
+
+    nodes.push_back(leaf);
+    return static_cast<int>(nodes.size()) - 1;
+}
+
+static int buildRecursive(std::vector<BVHNode> &nodes,
+                          std::vector<BuildPrimitive> &prims,
+                          int begin,
+                          int end,
+                          int depth) {
+    AABB bounds, centroidBounds;
+    for (int i = begin; i < end; i++) {
+        bounds.expand(prims[i].bounds);
+        centroidBounds.expand(prims[i].centroid);
+    }
+
+    int count = end - begin;
+    if (count == 1)
+        return makeLeaf(nodes, bounds, begin, end);
+
+    int axis = centroidBounds.longestAxis();
+    float axisMin = centroidBounds.min[axis];
+    float axisExtent = centroidBounds.max[axis] - axisMin;
+
+    // all centroids coincide, nothing to split on
+    if (axisExtent <= 0.0f) {
+        if (count <= BVH_MAX_LEAF_SIZE)
+            return makeLeaf(nodes, bounds, begin, end);
+
+        int mid = begin + count / 2;
+        BVHNode interior;
+        interior.bounds = bounds;
+        interior.count = 0;
+        interior.axis = static_cast<unsigned short>(axis);
+
+        nodes.push_back(interior);
+        int self = static_cast<int>(nodes.size()) - 1;
+
+        buildRecursive(nodes, prims, begin, mid, depth + 1);
+        nodes[self].offset = buildRecursive(nodes, prims, mid, end, depth + 1);
+        return self;
+    }
+
+    // bin the centroids along the longest axis
+    BuildBin bins[BVH_NUM_BINS];
+    for (int i = begin; i < end; i++) {
+        int b = static_cast<int>(BVH_NUM_BINS * (prims[i].centroid[axis] - axisMin) / axisExtent);
+        b = std::min(b, BVH_NUM_BINS - 1);
+
+        bins[b].count++;
+        bins[b].bounds.expand(prims[i].bounds);
+    }
+
+    // sweep from the right to get the cost of every split plane
+    float rightArea[BVH_NUM_BINS - 1];
+    int rightCount[BVH_NUM_BINS - 1];
+
+    AABB accBounds;
+    int accCount = 0;
+    for (int b = BVH_NUM_BINS - 1; b > 0; b--) {
+        accBounds.expand(bins[b].bounds);
+        accCount += bins[b].count;
+
+        rightArea[b - 1] = accBounds.surfaceArea();
+        rightCount[b - 1] = accCount;
+    }
+
+    int bestSplit = -1;
+    float bestCost = std::numeric_limits<float>::infinity();
+
+    accBounds = AABB();
+    accCount = 0;
+    for (int b = 0; b < BVH_NUM_BINS - 1; b++) {
+        accBounds.expand(bins[b].bounds);
+        accCount += bins[b].count;
+
+        if (accCount == 0 || rightCount[b] == 0)
+            continue;
+
+        float cost = accCount * accBounds.surfaceArea() + rightCount[b] * rightArea[b];
+        if (cost < bestCost) {
+            bestCost = cost;
+            bestSplit = b;
+        }
+    }
+
+    float totalArea = bounds.surfaceArea();
+    float splitCost = totalArea > 0.0f
+                      ? BVH_TRAVERSAL_COST + bestCost / totalArea
+                      : std::numeric_limits<float>::infinity();
+
+    if (count <= BVH_MAX_LEAF_SIZE && splitCost >= static_cast<float>(count))
+        return makeLeaf(nodes, bounds, begin, end);
+
+    int mid;
+    if (depth >= BVH_MAX_SAH_DEPTH) {
+        mid = begin + count / 2;
+        std::nth_element(&prims[begin], &prims[mid], &prims[end - 1] + 1,
+            [=](const BuildPrimitive &a, const BuildPrimitive &b) {
+                return a.centroid[axis] < b.centroid[axis];
+            });
+    } else if (bestSplit >= 0) {
+        BuildPrimitive *pmid = std::partition(&prims[begin], &prims[end - 1] + 1,
+            [=](const BuildPrimitive &p) {
+                int b = static_cast<int>(BVH_NUM_BINS * (p.centroid[axis] - axisMin) / axisExtent);
+                return std::min(b, BVH_NUM_BINS - 1) <= bestSplit;
+            });
+        mid = static_cast<int>(pmid - &prims[0]);
+    } else {
+        mid = begin + count / 2;
+    }
+
+    BVHNode interior;
+    interior.bounds = bounds;
+    interior.count = 0;
+    interior.axis = static_cast<unsigned short>(axis);
+
+    nodes.push_back(interior);
+    int self = static_cast<int>(nodes.size()) - 1;
+
+    buildRecursive(nodes, prims, begin, mid, depth + 1);
+    nodes[self].offset = buildRecursive(nodes, prims, mid, end, depth + 1);
+    return self;
+}
+
+BVH::BVH()
+        : attached{nullptr}
+        , numAttached{0}
+        , nodes{}
+        , indices{} {}
+
+void BVH::build(const std::vector<AABB> &bounds) {
+    std::vector<int> ids(bounds.size());
+    for (unsigned i = 0; i < ids.size(); i++)
+        ids[i] = static_cast<int>(i);
+
+    build(bounds, ids);
+}
+
+void BVH::build(const std::vector<AABB> &bounds, const std::vector<int> &ids) {
+    attached = nullptr;
+    numAttached = 0;
+    nodes.clear();
+    indices.clear();
+
+    if (bounds.empty())
+        return;
+
+    std::vector<BuildPrimitive> prims(bounds.size());
+    for (unsigned i = 0; i < bounds.size(); i++) {
+        prims[i].bounds = bounds[i];
+        prims[i].centroid = bounds[i].centroid();
+        prims[i].id = ids[i];
+    }
+
+    nodes.reserve(2 * prims.size());
+    buildRecursive(nodes, prims, 0, static_cast<int>(prims.size()), 0);
+
+    indices.resize(prims.size());
+    for (unsigned i = 0; i < prims.size(); i++)
+        indices[i] = prims[i].id;
+}
+
+bool BVH::empty() const {
+    return numNodes() == 0;
+}
+
+void BVH::attach(const BVHNode *data, int n) {
+    nodes.clear();
+    indices.clear();
+
+    attached = data;
+    numAttached = n;
+}
+
+const BVHNode *BVH::nodeData() const {
+    return attached ? attached : nodes.data();
+}
+
+int BVH::numNodes() const {
+    return attached ? numAttached : static_cast<int>(nodes.size());
+}
+
+void BVH::refit(const std::vector<AABB> &bounds) {
+    // children are stored after their parent, so a backwards sweep sees
+    // both children of a node before the node itself
+    for (int i = static_cast<int>(nodes.size()) - 1; i >= 0; i--) {
+        BVHNode &node = nodes[i];
+        AABB box;
+
+        if (node.count > 0) {
+            for (int j = node.offset; j < node.offset + node.count; j++)
+                box.expand(bounds[indices[j]]);
+        } else {
+            box.expand(nodes[i + 1].bounds);
+            box.expand(nodes[node.offset].bounds);
+        }
+
+        node.bounds = box;
+    }
+}
+
+std::vector<int> BVH::takeLeafOrder() {
+    std::vector<int> order(indices.size());
+
+    for (unsigned i = 0; i < order.size(); i++)
+        order[i] = static_cast<int>(i);
+
+    order.swap(indices);
+    return order;
+}
@@ -0,0 +1,233 @@
+#pragma once
+
+#include <vector>
+
+#include "AABB.h"
+#include "Stats.h"
+#include "Packet.h"
+
+#include <glm/glm.hpp>
+
+// flattened (depth-first) BVH node, the left child of an interior
+// node is always stored right after it
+struct BVHNode {
+    AABB bounds;
+    int offset;            // leaf: first entry in indices, interior: second child
+    unsigned short count;  // number of primitives, 0 for interior nodes
+    unsigned short axis;   // split axis of interior nodes
+};
+
+class BVH {
+private:
+    // nodes of someone else that are used instead of nodes, see attach()
+    const BVHNode *attached;
+    int numAttached;
+
+public:
+    // entries of the traversal stack, the walks cannot go deeper below the
+    // root than this
+    static const int STACK_SIZE = 128;
+
+    std::vector<BVHNode> nodes;
+    std::vector<int> indices;
+
+    BVH();
+
+    // build with the binned surface area heuristic, leaves refer to ids[i]
+    // (or simply i when no ids are given) for a primitive with bounds[i]
+    void build(const std::vector<AABB> &bounds);
+    void build(const std::vector<AABB> &bounds, const std::vector<int> &ids);
+
+    bool empty() const;
+
+    // walks the n nodes at data (laid out like nodes) instead of nodes,
+    // without copying them. data has to outlive the BVH and its copies, and
+    // the tree cannot be built or refit afterwards. Only the leaf walks
+    // work, there are no indices
+    void attach(const BVHNode *data, int n);
+    const BVHNode *nodeData() const;
+    int numNodes() const;
+
+    // recomputes every box from bounds[id] of the ids in the leaves, keeping
+    // the tree itself. Cheaper than build() when primitives have moved but
+    // stayed close to each other (e.g. under a scale or translation)
+    void refit(const std::vector<AABB> &bounds);
+
+    // for owners that store their primitives in leaf order: returns the
+    // current order (indices) and resets indices to 0, 1, 2, ... so that
+    // the leaf ranges address the reordered primitives directly
+    std::vector<int> takeLeafOrder();
+
+    // walks every leaf whose box overlaps [t0, t1], nearer child first.
+    // visit(id, t1) may shrink t1 to cull farther nodes and returns true
+    // to stop the traversal, in which case traverse() returns true as well
+    template <typename Visitor>
+    bool traverse(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, Visitor &visit) const;
+
+    // same walk, but visit(first, count, t1) gets each leaf as a whole, its
+    // primitives are indices[first] ... indices[first + count - 1]
+    template <typename Visitor>
+    bool traverseLeaves(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, Visitor &visit) const;
+
+    // packet version of traverse(), a node is entered when its box overlaps
+    // [t0, t1] for any active lane. visit(id) is expected to shrink t1 (which
+    // is read again after every call) as lanes find nearer hits
+    template <typename Visitor>
+    void traversePacket(const RayPacket &rays, const PacketFloat &t0, const PacketFloat &t1, Visitor &visit) const;
+
+    // same walk, visit(first, count) gets each leaf as a whole
+    template <typename Visitor>
+    void traversePacketLeaves(const RayPacket &rays, const PacketFloat &t0, const PacketFloat &t1, Visitor &visit) const;
+};
+
+// slab test of a box against every lane of a packet, mirrors AABB::intersectRay
+inline PacketMask intersectPacketAABB(const AABB &box,
+                                      const RayPacket &rays,
+                                      PacketFloat t0,
+                                      PacketFloat t1) {
+
+    const PacketFloat *invD[3] = { &rays.invDx, &rays.invDy, &rays.invDz };
+    const float scale = 1.0f + 2.0f * 3.0f * std::numeric_limits<float>::epsilon();
+
+    for (int a = 0; a < 3; a++) {
+        PacketFloat tNear = PacketFloat(box.min[a] - rays.e[a]) * *invD[a];
+        PacketFloat tFar  = PacketFloat(box.max[a] - rays.e[a]) * *invD[a];
+
+        PacketMask swap = tNear > tFar;
+        PacketFloat lo = select(swap, tFar, tNear);
+        PacketFloat hi = select(swap, tNear, tFar) * PacketFloat(scale);
+
+        t0 = select(lo > t0, lo, t0);
+        t1 = select(hi < t1, hi, t1);
+    }
+
+    return rays.active & (t0 <= t1);
+}
+
+template <typename Visitor>
+bool BVH::traverse(const glm::vec3 &e,
+                   const glm::vec3 &d,
+                   float t0,
+                   float t1,
+                   Visitor &visit) const {
+
+    auto visitLeaf = [&](int first, int count, float &tMax) {
+        for (int i = first; i < first + count; i++) {
+            if (visit(indices[i], tMax))
+                return true;
+        }
+        return false;
+    };
+
+    return traverseLeaves(e, d, t0, t1, visitLeaf);
+}
+
+template <typename Visitor>
+bool BVH::traverseLeaves(const glm::vec3 &e,
+                         const glm::vec3 &d,
+                         float t0,
+                         float t1,
+                         Visitor &visit) const {
+
+    const BVHNode *all = nodeData();
+
+    if (numNodes() == 0)
+        return false;
+
+    glm::vec3 invD(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+    bool dirIsNeg[3] = { invD.x < 0.0f, invD.y < 0.0f, invD.z < 0.0f };
+
+    int stack[STACK_SIZE];
+    int stackSize = 0;
+    int current = 0;
+
+    while (true) {
+        const BVHNode &node = all[current];
+        bool entered = node.bounds.intersectRay(e, invD, t0, t1);
+        SRT_COUNT_NODE(!entered);
+
+        if (entered) {
+            if (node.count > 0) {
+                if (visit(node.offset, static_cast<int>(node.count), t1))
+                    return true;
+            } else if (dirIsNeg[node.axis]) {
+                stack[stackSize++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[stackSize++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+
+        current = stack[--stackSize];
+    }
+
+    return false;
+}
+
+template <typename Visitor>
+void BVH::traversePacket(const RayPacket &rays,
+                         const PacketFloat &t0,
+                         const PacketFloat &t1,
+                         Visitor &visit) const {
+
+    auto visitLeaf = [&](int first, int count) {
+        for (int i = first; i < first + count; i++)
+            visit(indices[i]);
+    };
+
+    traversePacketLeaves(rays, t0, t1, visitLeaf);
+}
+
+template <typename Visitor>
+void BVH::traversePacketLeaves(const RayPacket &rays,
+                               const PacketFloat &t0,
+                               const PacketFloat &t1,
+                               Visitor &visit) const {
+
+    const BVHNode *all = nodeData();
+
+    if (numNodes() == 0 || !rays.active.any())
+        return;
+
+    // the packet is coherent, so the nearer child is picked by the first active lane
+    int lead = 0;
+    while (!rays.active.lane(lead))
+        lead++;
+
+    bool dirIsNeg[3] = { rays.invDx[lead] < 0.0f, rays.invDy[lead] < 0.0f, rays.invDz[lead] < 0.0f };
+
+    int stack[STACK_SIZE];
+    int stackSize = 0;
+    int current = 0;
+
+    while (true) {
+        const BVHNode &node = all[current];
+        bool entered = intersectPacketAABB(node.bounds, rays, t0, t1).any();
+        SRT_COUNT_NODE(!entered);
+
+        if (entered) {
+            if (node.count > 0) {
+                visit(node.offset, static_cast<int>(node.count));
+            } else if (dirIsNeg[node.axis]) {
+                stack[stackSize++] = current + 1;
+                current = node.offset;
+                continue;
+            } else {
+                stack[stackSize++] = node.offset;
+                current = current + 1;
+                continue;
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+
+        current = stack[--stackSize];
+    }
+}
@@ -0,0 +1,570 @@
+#include "ImageWriter.h"
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+
+// the same rounding as write_matrix_to_png
+static unsigned char toByte(float f) {
+    return static_cast<unsigned char>(std::round(std::max(std::min(1.0f, f), 0.0f) * 255));
+}
+
+static void putBigEndian(std::uint32_t value, unsigned char *p) {
+    p[0] = static_cast<unsigned char>(value >> 24);
+    p[1] = static_cast<unsigned char>(value >> 16);
+    p[2] = static_cast<unsigned char>(value >> 8);
+    p[3] = static_cast<unsigned char>(value);
+}
+
+static const int HASH_BITS = 15;
+
+// Deflate (RFC 1951) with the fixed Huffman codes and one hash entry per
+// 3 byte string for finding matches. Every call to compress() adds one
+// block to the same stream, and matches reach back into the previous
+// 32 KB, so feeding an image row band by row band costs little compression
+class Deflater {
+private:
+    static const int WINDOW_SIZE = 32768;
+    static const int MIN_MATCH = 3;
+    static const int MAX_MATCH = 258;
+
+    std::vector<unsigned char> window;  // the last WINDOW_SIZE bytes and then the new ones
+    long long windowStart;              // stream position of window[0]
+    std::vector<long long> head;        // last stream position of each hash, -1 if none
+
+    std::uint32_t bitBuffer;
+    int bitCount;
+
+    void putBits(std::uint32_t value, int n, std::vector<unsigned char> &out);
+    // Huffman codes go most significant bit first
+    void putCode(std::uint32_t code, int n, std::vector<unsigned char> &out);
+    void putSymbol(int symbol, std::vector<unsigned char> &out);
+    void putMatch(int length, int distance, std::vector<unsigned char> &out);
+
+public:
+    Deflater();
+
+    // appends a (not final) block holding data to out
+    void compress(const unsigned char *data, size_t n, std::vector<unsigned char> &out);
+    // appends the final (empty) block and flushes the last bits
+    void finish(std::vector<unsigned char> &out);
+};
+
+// std::min and friends take these by reference, so they need a definition
+const int Deflater::WINDOW_SIZE;
+const int Deflater::MIN_MATCH;
+const int Deflater::MAX_MATCH;
+
+static const int LENGTH_BASE[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const int LENGTH_EXTRA[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const int DISTANCE_BASE[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const int DISTANCE_EXTRA[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+Deflater::Deflater()
+        : window{}
+        , windowStart{0}
+        , head(1 << HASH_BITS, -1)
+        , bitBuffer{0}
+        , bitCount{0} {}
+
+void Deflater::putBits(std::uint32_t value, int n, std::vector<unsigned char> &out) {
+    bitBuffer |= value << bitCount;
+    bitCount += n;
+
+    while (bitCount >= 8) {
+        out.push_back(static_cast<unsigned char>(bitBuffer));
+        bitBuffer >>= 8;
+        bitCount -= 8;
+    }
+}
+
+void Deflater::putCode(std::uint32_t code, int n, std::vector<unsigned char> &out) {
+    std::uint32_t reversed = 0;
+    for (int k = 0; k < n; k++)
+        reversed |= ((code >> k) & 1) << (n - 1 - k);
+
+    putBits(reversed, n, out);
+}
+
+void Deflater::putSymbol(int symbol, std::vector<unsigned char> &out) {
+    if (symbol < 144)
+        putCode(0x30 + symbol, 8, out);
+    else if (symbol < 256)
+        putCode(0x190 + symbol - 144, 9, out);
+    else if (symbol < 280)
+        putCode(symbol - 256, 7, out);
+    else
+        putCode(0xc0 + symbol - 280, 8, out);
+}
+
+void Deflater::putMatch(int length, int distance, std::vector<unsigned char> &out) {
+    int l = 28;
+    while (LENGTH_BASE[l] > length)
+        l--;
+
+    putSymbol(257 + l, out);
+    putBits(length - LENGTH_BASE[l], LENGTH_EXTRA[l], out);
+
+    int d = 29;
+    while (DISTANCE_BASE[d] > distance)
+        d--;
+
+    putCode(d, 5, out);
+    putBits(distance - DISTANCE_BASE[d], DISTANCE_EXTRA[d], out);
+}
+
+static int hash3(const unsigned char *p) {
+    std::uint32_t key = (std::uint32_t(p[0]) << 16) | (std::uint32_t(p[1]) << 8) | p[2];
+    return static_cast<int>((key * 2654435761u) >> (32 - HASH_BITS));
+}
+
+void Deflater::compress(const unsigned char *data, size_t n, std::vector<unsigned char> &out) {
+    if (n == 0)
+        return;
+
+    size_t begin = window.size();
+    window.insert(window.end(), data, data + n);
+    const int end = static_cast<int>(window.size());
+
+    // not final, fixed Huffman codes
+    putBits(0, 1, out);
+    putBits(1, 2, out);
+
+    int p = static_cast<int>(begin);
+    while (p < end) {
+        int length = 0, distance = 0;
+
+        if (p + MIN_MATCH <= end) {
+            int h = hash3(&window[p]);
+            long long candidate = head[h];
+            head[h] = windowStart + p;
+
+            if (candidate >= windowStart && windowStart + p - candidate <= WINDOW_SIZE) {
+                int q = static_cast<int>(candidate - windowStart);
+                int maxLength = std::min(MAX_MATCH, end - p);
+
+                while (length < maxLength && window[q + length] == window[p + length])
+                    length++;
+
+                distance = p - q;
+            }
+        }
+
+        if (length < MIN_MATCH) {
+            putSymbol(window[p], out);
+            p++;
+            continue;
+        }
+
+        putMatch(length, distance, out);
+
+        // the strings inside the match can be matched later on
+        for (int k = p + 1; k < p + length && k + MIN_MATCH <= end; k++)
+            head[hash3(&window[k])] = windowStart + k;
+
+        p += length;
+    }
+
+    // end of block
+    putSymbol(256, out);
+
+    if (window.size() > WINDOW_SIZE) {
+        size_t drop = window.size() - WINDOW_SIZE;
+        window.erase(window.begin(), window.begin() + drop);
+        windowStart += static_cast<long long>(drop);
+    }
+}
+
+void Deflater::finish(std::vector<unsigned char> &out) {
+    putBits(1, 1, out);
+    putBits(1, 2, out);
+    putSymbol(256, out);
+
+    if (bitCount > 0)
+        putBits(0, 8 - bitCount, out);
+}
+
+static std::uint32_t crc32(std::uint32_t crc, const unsigned char *data, size_t n) {
+    static const std::vector<std::uint32_t> table = [] {
+        std::vector<std::uint32_t> t(256);
+        for (std::uint32_t i = 0; i < 256; i++) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < n; i++)
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+static std::uint32_t adler32(std::uint32_t adler, const unsigned char *data, size_t n) {
+    std::uint32_t a = adler & 0xffff, b = adler >> 16;
+
+    while (n > 0) {
+        // the largest run that cannot overflow b
+        size_t run = std::min<size_t>(n, 5552);
+        for (size_t i = 0; i < run; i++) {
+            a += data[i];
+            b += a;
+        }
+
+        a %= 65521;
+        b %= 65521;
+        data += run;
+        n -= run;
+    }
+
+    return (b << 16) | a;
+}
+
+// the file handling shared by every format
+class FileImageWriter : public ImageWriter {
+protected:
+    std::ofstream out;
+    std::string filename;
+    int width;
+    int height;
+    int rowsWritten;
+
+    bool openFile(const std::string &name, int w, int h) {
+        filename = name;
+        width = w;
+        height = h;
+        rowsWritten = 0;
+
+        out.open(name, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            std::cerr << "Failed to create " << name << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool closeFile() {
+        out.close();
+
+        if (!out) {
+            std::cerr << "Failed to write " << filename << std::endl;
+            return false;
+        }
+
+        if (rowsWritten != height) {
+            std::cerr << filename << " got " << rowsWritten << " of " << height << " rows" << std::endl;
+            return false;
+        }
+
+        return true;
+    }
+};
+
+// 8 bit RGB, one IDAT chunk per writeRows call. Every row is filtered with
+// "up" (the difference to the row above), which suits smooth renders
+class PNGWriter : public FileImageWriter {
+private:
+    Deflater deflater;
+    std::uint32_t adler;
+    std::vector<unsigned char> previousRow;
+    std::vector<unsigned char> raw;
+    std::vector<unsigned char> compressed;
+
+    void writeChunk(const char *type, const unsigned char *data, size_t n) {
+        unsigned char header[8];
+        putBigEndian(static_cast<std::uint32_t>(n), header);
+        std::memcpy(header + 4, type, 4);
+
+        std::uint32_t crc = crc32(0, header + 4, 4);
+        crc = crc32(crc, data, n);
+
+        unsigned char footer[4];
+        putBigEndian(crc, footer);
+
+        out.write(reinterpret_cast<const char*>(header), 8);
+        out.write(reinterpret_cast<const char*>(data), n);
+        out.write(reinterpret_cast<const char*>(footer), 4);
+    }
+
+public:
+    bool open(const std::string &name, int w, int h) override {
+        if (!openFile(name, w, h))
+            return false;
+
+        static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        out.write(reinterpret_cast<const char*>(SIGNATURE), 8);
+
+        // 8 bits per channel, RGB, no interlacing
+        unsigned char ihdr[13] = { 0 };
+        putBigEndian(static_cast<std::uint32_t>(w), ihdr);
+        putBigEndian(static_cast<std::uint32_t>(h), ihdr + 4);
+        ihdr[8] = 8;
+        ihdr[9] = 2;
+        writeChunk("IHDR", ihdr, sizeof(ihdr));
+
+        deflater = Deflater();
+        adler = 1;
+        previousRow.assign(3 * static_cast<size_t>(w), 0);
+
+        // zlib header: deflate with a 32 KB window, no dictionary
+        compressed.assign(1, 0x78);
+        compressed.push_back(0x01);
+
+        return static_cast<bool>(out);
+    }
+
+    bool writeRows(const glm::vec4 *pixels, int numRows) override {
+        const size_t rowBytes = 3 * static_cast<size_t>(width);
+        raw.resize(numRows * (rowBytes + 1));
+
+        for (int y = 0; y < numRows; y++) {
+            unsigned char *row = &raw[y * (rowBytes + 1)];
+            row[0] = 2;
+
+            for (int x = 0; x < width; x++) {
+                const glm::vec4 &p = pixels[static_cast<size_t>(y) * width + x];
+                unsigned char rgb[3] = { toByte(p.r), toByte(p.g), toByte(p.b) };
+
+                for (int c = 0; c < 3; c++) {
+                    row[1 + 3 * x + c] = static_cast<unsigned char>(rgb[c] - previousRow[3 * x + c]);
+                    previousRow[3 * x + c] = rgb[c];
+                }
+            }
+        }
+
+        adler = adler32(adler, raw.data(), raw.size());
+        deflater.compress(raw.data(), raw.size(), compressed);
+
+        writeChunk("IDAT", compressed.data(), compressed.size());
+        compressed.clear();
+
+        rowsWritten += numRows;
+        return static_cast<bool>(out);
+    }
+
+    bool close() override {
+        deflater.finish(compressed);
+
+        unsigned char checksum[4];
+        putBigEndian(adler, checksum);
+        compressed.insert(compressed.end(), checksum, checksum + 4);
+
+        writeChunk("IDAT", compressed.data(), compressed.size());
+        writeChunk("IEND", nullptr, 0);
+
+        return closeFile();
+    }
+};
+
+// binary PPM (P6), 8 bit RGB
+class PPMWriter : public FileImageWriter {
+private:
+    std::vector<unsigned char> bytes;
+
+public:
+    bool open(const std::string &name, int w, int h) override {
+        if (!openFile(name, w, h))
+            return false;
+
+        out << "P6\n" << w << " " << h << "\n255\n";
+        return static_cast<bool>(out);
+    }
+
+    bool writeRows(const glm::vec4 *pixels, int numRows) override {
+        size_t n = static_cast<size_t>(numRows) * width;
+        bytes.resize(3 * n);
+
+        for (size_t k = 0; k < n; k++) {
+            bytes[3 * k + 0] = toByte(pixels[k].r);
+            bytes[3 * k + 1] = toByte(pixels[k].g);
+            bytes[3 * k + 2] = toByte(pixels[k].b);
+        }
+
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+        rowsWritten += numRows;
+        return static_cast<bool>(out);
+    }
+
+    bool close() override {
+        return closeFile();
+    }
+};
+
+class RawWriter : public FileImageWriter {
+public:
+    bool open(const std::string &name, int w, int h) override {
+        return openFile(name, w, h);
+    }
+
+    bool writeRows(const glm::vec4 *pixels, int numRows) override {
+        out.write(reinterpret_cast<const char*>(pixels), static_cast<size_t>(numRows) * width * sizeof(glm::vec4));
+        rowsWritten += numRows;
+        return static_cast<bool>(out);
+    }
+
+    bool close() override {
+        return closeFile();
+    }
+};
+
+static bool littleEndian() {
+    const std::uint16_t one = 1;
+    unsigned char first;
+    std::memcpy(&first, &one, 1);
+    return first == 1;
+}
+
+// RGB 32 bit floats in the byte order of the machine, which a negative
+// scale in the header marks as little endian
+class PFMWriter : public FileImageWriter {
+private:
+    std::streamoff dataStart;
+    std::vector<float> floats;
+
+public:
+    bool open(const std::string &name, int w, int h) override {
+        if (!openFile(name, w, h))
+            return false;
+
+        out << "PF\n" << w << " " << h << "\n" << (littleEndian() ? "-1.0" : "1.0") << "\n";
+        dataStart = out.tellp();
+        return static_cast<bool>(out);
+    }
+
+    bool writeRows(const glm::vec4 *pixels, int numRows) override {
+        const size_t rowFloats = 3 * static_cast<size_t>(width);
+        floats.resize(numRows * rowFloats);
+
+        // the last row of the band comes first in the file
+        for (int y = 0; y < numRows; y++) {
+            float *row = &floats[(numRows - 1 - y) * rowFloats];
+
+            for (int x = 0; x < width; x++) {
+                const glm::vec4 &p = pixels[static_cast<size_t>(y) * width + x];
+                row[3 * x + 0] = p.r;
+                row[3 * x + 1] = p.g;
+                row[3 * x + 2] = p.b;
+            }
+        }
+
+        // rows [rowsWritten, rowsWritten + numRows) from the top
+        std::streamoff firstRow = height - rowsWritten - numRows;
+        out.seekp(dataStart + firstRow * static_cast<std::streamoff>(rowFloats * sizeof(float)));
+        out.write(reinterpret_cast<const char*>(floats.data()), floats.size() * sizeof(float));
+
+        rowsWritten += numRows;
+        return static_cast<bool>(out);
+    }
+
+    bool close() override {
+        return closeFile();
+    }
+};
+
+std::unique_ptr<ImageWriter> ImageWriter::create(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::PNG: return std::unique_ptr<ImageWriter>(new PNGWriter());
+    case ImageFormat::PPM: return std::unique_ptr<ImageWriter>(new PPMWriter());
+    case ImageFormat::Raw: return std::unique_ptr<ImageWriter>(new RawWriter());
+    case ImageFormat::PFM: return std::unique_ptr<ImageWriter>(new PFMWriter());
+    }
+
+    return nullptr;
+}
+
+bool ImageWriter::parseFormat(const std::string &name, ImageFormat &format) {
+    if (name == "png")
+        format = ImageFormat::PNG;
+    else if (name == "ppm")
+        format = ImageFormat::PPM;
+    else if (name == "raw")
+        format = ImageFormat::Raw;
+    else if (name == "pfm")
+        format = ImageFormat::PFM;
+    else
+        return false;
+
+    return true;
+}
+
+const char *ImageWriter::extension(ImageFormat format) {
+    switch (format) {
+    case ImageFormat::PNG: return ".png";
+    case ImageFormat::PPM: return ".ppm";
+    case ImageFormat::Raw: return ".raw";
+    case ImageFormat::PFM: return ".pfm";
+    }
+
+    return "";
+}
+
+bool ImageWriter::isHDR(ImageFormat format) {
+    return format == ImageFormat::Raw || format == ImageFormat::PFM;
+}
+
+bool readPFM(const std::string &filename, std::vector<glm::vec4> &pixels, int &width, int &height) {
+    std::ifstream in(filename, std::ios::binary);
+    if (!in) {
+        std::cerr << "Failed to open " << filename << std::endl;
+        return false;
+    }
+
+    std::string magic;
+    float scale = 0.0f;
+    in >> magic >> width >> height >> scale;
+
+    // exactly one whitespace character ends the header
+    in.get();
+
+    if (!in || magic != "PF" || width <= 0 || height <= 0 || scale == 0.0f) {
+        std::cerr << filename << " is not an RGB PFM" << std::endl;
+        return false;
+    }
+
+    const size_t rowFloats = 3 * static_cast<size_t>(width);
+    std::vector<float> row(rowFloats);
+    const bool swap = (scale < 0.0f) != littleEndian();
+
+    pixels.resize(static_cast<size_t>(width) * height);
+
+    for (int y = height - 1; y >= 0; y--) {
+        in.read(reinterpret_cast<char*>(row.data()), rowFloats * sizeof(float));
+        if (!in) {
+            std::cerr << filename << " ends before its last row" << std::endl;
+            return false;
+        }
+
+        if (swap) {
+            for (float &f : row) {
+                unsigned char *b = reinterpret_cast<unsigned char*>(&f);
+                std::swap(b[0], b[3]);
+                std::swap(b[1], b[2]);
+            }
+        }
+
+        for (int x = 0; x < width; x++)
+            pixels[static_cast<size_t>(y) * width + x] = glm::vec4(row[3 * x], row[3 * x + 1], row[3 * x + 2], 1.0f);
+    }
+
+    return true;
+}
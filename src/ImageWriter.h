@@ -0,0 +1,42 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+enum class ImageFormat { PNG, PPM, Raw, PFM };
+
+// Writes an image to disk row by row, top to bottom, while it is being
+// rendered, so only the rows passed to one writeRows call have to be in
+// memory. PNG and PPM store 8 bit RGB (clamped to [0, 1] and rounded like
+// the PNG of stb), raw stores the floats as they are: width x height x 4
+// (RGBA) 32 bit floats in the byte order of the machine, without a header.
+// PFM keeps the floats of RGB as well, behind a header that most HDR tools
+// read. Its rows go from the bottom up, so each band is written to its
+// place in the file instead of after the previous one.
+class ImageWriter {
+public:
+    virtual ~ImageWriter() {}
+
+    // false (with a message on stderr) if the file cannot be created
+    virtual bool open(const std::string &filename, int width, int height) = 0;
+    // the next numRows rows, pixels holds numRows * width of them
+    virtual bool writeRows(const glm::vec4 *pixels, int numRows) = 0;
+    // false if writing failed or fewer than height rows were written
+    virtual bool close() = 0;
+
+    static std::unique_ptr<ImageWriter> create(ImageFormat format);
+
+    // "png", "ppm", "raw" or "pfm"
+    static bool parseFormat(const std::string &name, ImageFormat &format);
+    static const char *extension(ImageFormat format);
+    // formats that store more than 8 bits and so are not tone mapped
+    static bool isHDR(ImageFormat format);
+};
+
+// reads an RGB PFM (as written above, in either byte order) into pixels,
+// top row first, with alpha 1. false (with a message on stderr) if the file
+// cannot be read or is not such a PFM
+bool readPFM(const std::string &filename, std::vector<glm::vec4> &pixels, int &width, int &height);
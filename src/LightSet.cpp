@@ -0,0 +1,73 @@
+#include "LightSet.h"
+
+#include <algorithm>
+
+static float brightness(const LightNode &node) {
+    glm::vec3 c = node.diffuse + node.specular;
+    return c.x + c.y + c.z;
+}
+
+LightSet::LightSet()
+        : ambient{0.0f} {}
+
+void LightSet::build(const std::vector<Light> &lights) {
+    ambient = glm::vec3(0.0f);
+    directionals.clear();
+    points.clear();
+    nodes.clear();
+
+    for (int j = 0; j < static_cast<int>(lights.size()); j++) {
+        const Light &light = lights[j];
+        ambient += light.ambient;
+
+        if (light.type == LightType::Point)
+            points.push_back(ShadingLight{ light.diffuse, light.specular, light.position, j });
+        else if (light.type == LightType::Directional)
+            directionals.push_back(ShadingLight{ light.diffuse, light.specular, glm::normalize(-1.0f * light.direction), j });
+    }
+
+    if (!points.empty()) {
+        nodes.reserve(2 * points.size() - 1);
+        buildNode(0, static_cast<int>(points.size()));
+    }
+}
+
+int LightSet::buildNode(int first, int last) {
+    int n = static_cast<int>(nodes.size());
+    nodes.emplace_back();
+
+    if (last - first == 1) {
+        LightNode &leaf = nodes[n];
+        leaf.box = AABB(points[first].v, points[first].v);
+        leaf.diffuse = points[first].diffuse;
+        leaf.specular = points[first].specular;
+        leaf.representative = first;
+        leaf.left = leaf.right = -1;
+        return n;
+    }
+
+    AABB box;
+    for (int k = first; k < last; k++)
+        box.expand(points[k].v);
+
+    int axis = box.longestAxis();
+    int mid = (first + last) / 2;
+    std::nth_element(points.begin() + first, points.begin() + mid, points.begin() + last,
+                     [axis](const ShadingLight &a, const ShadingLight &b) {
+        return a.v[axis] < b.v[axis] || (a.v[axis] == b.v[axis] && a.index < b.index);
+    });
+
+    // nodes grows meanwhile, so node n is only looked up afterwards
+    int left = buildNode(first, mid);
+    int right = buildNode(mid, last);
+
+    LightNode &node = nodes[n];
+    node.box = box;
+    node.diffuse = nodes[left].diffuse + nodes[right].diffuse;
+    node.specular = nodes[left].specular + nodes[right].specular;
+    node.representative = brightness(nodes[left]) >= brightness(nodes[right])
+                        ? nodes[left].representative : nodes[right].representative;
+    node.left = left;
+    node.right = right;
+    return n;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+
+#include "AABB.h"
+#include "Light.h"
+
+#include <glm/glm.hpp>
+
+// a light as the shading loop needs it
+struct ShadingLight {
+    glm::vec3 diffuse;
+    glm::vec3 specular;
+    glm::vec3 v;    // position of a point light, unit vector towards a directional one
+    int index;      // into Scene::lights, which the occluder cache is kept by
+};
+
+// a cluster of point lights in the light tree. Its representative stands
+// in for all of them: shading it with the summed colors of the cluster
+// approximates shading every light of the cluster one by one
+struct LightNode {
+    AABB box;
+    glm::vec3 diffuse;      // summed over the cluster
+    glm::vec3 specular;
+    int representative;     // into LightSet::points
+    int left, right;        // children, -1 for a single light
+};
+
+// the lights of a scene prepared once per render: the ambient terms are
+// summed, directional lights have their direction normalized, and each kind
+// sits in its own array. Point lights also get a binary tree of clusters
+// (split at the median of the longest axis), which the renderer cuts per
+// hit point when there are too many of them to shade one by one
+class LightSet {
+public:
+    glm::vec3 ambient;
+    std::vector<ShadingLight> directionals;
+    std::vector<ShadingLight> points;   // in the order of the leaves of the tree
+    std::vector<LightNode> nodes;       // nodes[0] is the root
+
+    LightSet();
+
+    void build(const std::vector<Light> &lights);
+
+private:
+    int buildNode(int first, int last);
+};
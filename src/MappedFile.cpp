@@ -0,0 +1,141 @@
+#include "MappedFile.h"
+
+#include <iostream>
+
+#if defined(_WIN32)
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile()
+        : bytes{nullptr}
+        , length{0}
+#if defined(_WIN32)
+        , file{INVALID_HANDLE_VALUE}
+        , mapping{nullptr}
+#endif
+{}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const std::string &filepath) {
+    close();
+
+    file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                       OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+    if (file == INVALID_HANDLE_VALUE) {
+        std::cerr << "Failed to open " << filepath << std::endl;
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+        std::cerr << "Failed to read the size of " << filepath << std::endl;
+        close();
+        return false;
+    }
+
+    length = static_cast<std::size_t>(fileSize.QuadPart);
+
+    // an empty file cannot be mapped, it is simply empty
+    if (length == 0)
+        return true;
+
+    mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (mapping != nullptr)
+        bytes = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+
+    if (bytes == nullptr) {
+        std::cerr << "Failed to map " << filepath << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes != nullptr)
+        UnmapViewOfFile(bytes);
+    if (mapping != nullptr)
+        CloseHandle(mapping);
+    if (file != INVALID_HANDLE_VALUE)
+        CloseHandle(file);
+
+    bytes = nullptr;
+    length = 0;
+    file = INVALID_HANDLE_VALUE;
+    mapping = nullptr;
+}
+
+#else
+
+bool MappedFile::open(const std::string &filepath) {
+    close();
+
+    int fd = ::open(filepath.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+        std::cerr << "Failed to open " << filepath << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        std::cerr << "Failed to read the size of " << filepath << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    // an empty file cannot be mapped, it is simply empty
+    if (info.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+
+    void *address = mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+
+    if (address == MAP_FAILED) {
+        std::cerr << "Failed to map " << filepath << std::endl;
+        return false;
+    }
+
+    bytes = static_cast<const char*>(address);
+    length = static_cast<std::size_t>(info.st_size);
+
+    // parsers read front to back
+    madvise(address, length, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+void MappedFile::close() {
+    if (bytes != nullptr)
+        munmap(const_cast<char*>(bytes), length);
+
+    bytes = nullptr;
+    length = 0;
+}
+
+#endif
+
+const char *MappedFile::data() const {
+    return bytes;
+}
+
+std::size_t MappedFile::size() const {
+    return length;
+}
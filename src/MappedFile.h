@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// read-only memory mapping of a whole file, the pages are read in by the
+// OS as they are touched instead of being copied through a stream buffer
+class MappedFile {
+private:
+    const char *bytes;
+    std::size_t length;
+
+#if defined(_WIN32)
+    void *file;
+    void *mapping;
+#endif
+
+public:
+    MappedFile();
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile &operator=(const MappedFile&) = delete;
+
+    // false (with a message on stderr) if the file cannot be opened or mapped
+    bool open(const std::string &filepath);
+    void close();
+
+    const char *data() const;
+    std::size_t size() const;
+};
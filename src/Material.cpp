@@ -0,0 +1,52 @@
+#include "Material.h"
+
+Material::Material()
+        : shiness{0.0f}
+        , ka{glm::vec3(0.0f)}
+        , kd{glm::vec3(0.0f)}
+        , ks{glm::vec3(0.0f)}
+        , km{glm::vec3(0.0f)} {}
+
+Material::Material(float p,
+                   const glm::vec3 &a,
+                   const glm::vec3 &d,
+                   const glm::vec3 &s,
+                   const glm::vec3 &m)
+        : shiness{p}
+        , ka{glm::vec3(a)}
+        , kd{glm::vec3(d)}
+        , ks{glm::vec3(s)}
+        , km{glm::vec3(m)} {}
+
+int MaterialTable::size() const {
+    return static_cast<int>(materials.size());
+}
+
+void MaterialTable::reserve(int n) {
+    materials.reserve(n);
+    names.reserve(n);
+}
+
+int MaterialTable::add(const Material &material, const std::string &name) {
+    if (size() >= MAX_SIZE)
+        return -1;
+
+    if (!name.empty() && !names.insert(std::make_pair(name, static_cast<MaterialIndex>(size()))).second)
+        return -1;
+
+    materials.push_back(material);
+    return size() - 1;
+}
+
+bool MaterialTable::find(const std::string &name, MaterialIndex &index) const {
+    auto found = names.find(name);
+    if (found == names.end())
+        return false;
+
+    index = found->second;
+    return true;
+}
+
+const Material &MaterialTable::operator[](MaterialIndex i) const {
+    return materials[i];
+}
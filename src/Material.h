@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+class Material {
+public:
+    float shiness;
+    glm::vec3 ka;
+    glm::vec3 kd;
+    glm::vec3 ks;
+    glm::vec3 km;
+
+    Material();
+    Material(float p,
+             const glm::vec3 &a,
+             const glm::vec3 &d,
+             const glm::vec3 &s,
+             const glm::vec3 &m);
+};
+
+// what objects and hits refer to a material by
+typedef uint16_t MaterialIndex;
+
+// the materials of a scene, packed one after the other. Entries are only
+// added, never changed, so shading reads the fields it needs straight from
+// here instead of hits carrying copies of them
+class MaterialTable {
+public:
+    static const int MAX_SIZE = 1 << 16;
+
+    int size() const;
+    void reserve(int n);
+    // index of the new entry, -1 when the table is full or a material of
+    // the same (non empty) name is in it already
+    int add(const Material &material, const std::string &name = "");
+    bool find(const std::string &name, MaterialIndex &index) const;
+
+    const Material &operator[](MaterialIndex i) const;
+
+private:
+    std::vector<Material> materials;
+    std::unordered_map<std::string, MaterialIndex> names;
+};
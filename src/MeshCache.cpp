@@ -0,0 +1,217 @@
+#include "MeshCache.h"
+
+#include <limits>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <sys/stat.h>
+
+#include "MappedFile.h"
+
+static const char CACHE_MAGIC[8] = { 'S', 'R', 'T', 'M', 'E', 'S', 'H', '\0' };
+// bump whenever the layout below or the way meshes are built changes
+static const std::uint32_t CACHE_VERSION = 4;
+
+// caches are plain memory dumps that meshes use where they are mapped, a
+// different byte order, struct layout or packet width (which the padding of
+// the triangles depends on) makes them unusable
+static const std::uint32_t CACHE_LAYOUT = 0x01000000u
+                                        | static_cast<std::uint32_t>(PACKET_WIDTH) << 16
+                                        | static_cast<std::uint32_t>(sizeof(float)) << 8
+                                        | static_cast<std::uint32_t>(sizeof(BVHNode));
+
+// followed by the components of the triangles, as TriangleArray::attach
+// takes them, and the BVH nodes
+struct CacheHeader {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t layout;
+    std::uint64_t sourceSize;
+    std::int64_t sourceTime;
+    std::uint64_t sourceHash;
+    std::uint64_t numTriangles;
+    std::uint64_t numNodes;
+};
+
+// FNV-1a over 8 byte words, only has to notice that the source changed
+static std::uint64_t hashBytes(const char *data, std::size_t size) {
+    std::uint64_t hash = 14695981039346656037ull;
+    std::size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+
+    for (; i < size; i++)
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+
+    return hash;
+}
+
+static bool statFile(const std::string &filepath, std::uint64_t &size, std::int64_t &time) {
+    struct stat info;
+
+    if (stat(filepath.c_str(), &info) != 0)
+        return false;
+
+    size = static_cast<std::uint64_t>(info.st_size);
+    time = static_cast<std::int64_t>(info.st_mtime);
+    return true;
+}
+
+// size, mtime and hash of the source as they are now
+static bool describeSource(const std::string &source, CacheHeader &header) {
+    if (!statFile(source, header.sourceSize, header.sourceTime))
+        return false;
+
+    MappedFile file;
+    if (!file.open(source) || file.size() != header.sourceSize)
+        return false;
+
+    header.sourceHash = hashBytes(file.data(), file.size());
+    return true;
+}
+
+std::string MeshCache::pathFor(const std::string &source) {
+    return source + ".cache";
+}
+
+bool MeshCache::read(const std::string &source, TriangleMesh &mesh) {
+    std::string cachePath = pathFor(source);
+
+    std::uint64_t cacheSize;
+    std::int64_t cacheTime;
+
+    // no cache yet, nothing to report
+    if (!statFile(cachePath, cacheSize, cacheTime) || cacheSize < sizeof(CacheHeader))
+        return false;
+
+    // stays mapped for as long as the mesh (or a copy of it) is around
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+    if (!file->open(cachePath) || file->size() < sizeof(CacheHeader))
+        return false;
+
+    CacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(CacheHeader));
+
+    if (std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header.version != CACHE_VERSION || header.layout != CACHE_LAYOUT)
+        return false;
+
+    // the cheap checks first, the hash reads the whole source
+    std::uint64_t sourceSize;
+    std::int64_t sourceTime;
+
+    if (!statFile(source, sourceSize, sourceTime) ||
+        sourceSize != header.sourceSize || sourceTime != header.sourceTime)
+        return false;
+
+    CacheHeader current;
+    if (!describeSource(source, current) || current.sourceHash != header.sourceHash)
+        return false;
+
+    // counts that fit an int, so the sizes below cannot overflow
+    const std::uint64_t maxCount = std::numeric_limits<int>::max() - PACKET_WIDTH;
+
+    if (header.numTriangles > maxCount || header.numNodes > maxCount)
+        return false;
+
+    int numTriangles = static_cast<int>(header.numTriangles);
+    int numNodes = static_cast<int>(header.numNodes);
+
+    std::uint64_t trianglesSize = TriangleArray::NUM_COMPONENTS * TriangleArray::paddedSize(numTriangles) * sizeof(float);
+    std::uint64_t expectedSize = sizeof(CacheHeader) + trianglesSize + header.numNodes * sizeof(BVHNode);
+
+    if (expectedSize != file->size() || (numTriangles == 0) != (numNodes == 0))
+        return false;
+
+    // used where they are mapped, every member of both is 4 byte aligned
+    const float *triangles = reinterpret_cast<const float*>(file->data() + sizeof(CacheHeader));
+    const BVHNode *nodes = reinterpret_cast<const BVHNode*>(file->data() + sizeof(CacheHeader) + trianglesSize);
+
+    // never trust offsets read from disk. Children come after their parents,
+    // so the depth of every parent is known before its children get theirs
+    // (the deepest one, should a damaged node have two parents)
+    std::vector<int> depth(numNodes, 0);
+
+    for (int i = 0; i < numNodes; i++) {
+        const BVHNode &node = nodes[i];
+
+        bool valid = node.count > 0
+                     ? node.offset >= 0 && node.offset + node.count <= numTriangles
+                     : node.offset > i + 1 && node.offset < numNodes;
+
+        if (!valid)
+            return false;
+
+        if (node.count > 0)
+            continue;
+
+        // a walk into the children of node holds one more entry on its stack
+        int childDepth = depth[i] + 1;
+        if (childDepth > BVH::STACK_SIZE)
+            return false;
+
+        depth[i + 1] = std::max(depth[i + 1], childDepth);
+        depth[node.offset] = std::max(depth[node.offset], childDepth);
+    }
+
+    // triangles are stored in leaf order, see TriangleMesh::buildBVH
+    mesh.triangles.attach(triangles, numTriangles);
+    mesh.bvh.attach(nodes, numNodes);
+    mesh.mapping = file;
+    return true;
+}
+
+bool MeshCache::write(const std::string &source, const TriangleMesh &mesh) {
+    std::string cachePath = pathFor(source);
+
+    CacheHeader header;
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.layout = CACHE_LAYOUT;
+    header.numTriangles = mesh.triangles.size();
+    header.numNodes = mesh.bvh.numNodes();
+
+    if (!describeSource(source, header))
+        return false;
+
+    // written under a temporary name and renamed, so that an interrupted or
+    // concurrent run never leaves a partial cache behind
+    std::string tempPath = cachePath + ".tmp";
+    std::ofstream out(tempPath, std::ios::binary | std::ios::trunc);
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(CacheHeader));
+
+    std::size_t componentSize = TriangleArray::paddedSize(mesh.triangles.size()) * sizeof(float);
+    for (int k = 0; k < TriangleArray::NUM_COMPONENTS; k++)
+        out.write(reinterpret_cast<const char*>(mesh.triangles.component(k)), componentSize);
+
+    out.write(reinterpret_cast<const char*>(mesh.bvh.nodeData()), mesh.bvh.numNodes() * sizeof(BVHNode));
+    out.close();
+
+    if (!out) {
+        std::cerr << "Failed to write mesh cache " << cachePath << std::endl;
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    // rename does not replace an existing file everywhere
+    std::remove(cachePath.c_str());
+
+    if (std::rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+        std::cerr << "Failed to write mesh cache " << cachePath << std::endl;
+        std::remove(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
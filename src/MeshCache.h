@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+#include "TriangleMesh.h"
+
+// Binary copy of a loaded mesh (its triangles, as the intersection tests
+// read them, and their BVH), kept next to its source as <source>.cache. It
+// records the size, mtime and a hash of the source and is only used while
+// all three still match, so editing, replacing or touching the source makes
+// it rebuild. A mesh read from it uses the mapped file as it is, nothing is
+// copied or rebuilt.
+class MeshCache {
+public:
+    static std::string pathFor(const std::string &source);
+
+    // false if there is no cache for source or it is stale or damaged,
+    // mesh is left untouched in that case
+    static bool read(const std::string &source, TriangleMesh &mesh);
+    // false (with a message on stderr) if the cache cannot be written
+    static bool write(const std::string &source, const TriangleMesh &mesh);
+};
@@ -0,0 +1,38 @@
+#include "MeshLibrary.h"
+
+#include "MeshCache.h"
+
+std::shared_ptr<const TriangleMesh> MeshLibrary::loadOFF(const std::string &filepath, bool useMeshCache) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        auto found = meshes.find(filepath);
+        if (found != meshes.end())
+            return found->second;
+    }
+
+    std::shared_ptr<TriangleMesh> mesh = std::make_shared<TriangleMesh>();
+
+    bool cached = useMeshCache && MeshCache::read(filepath, *mesh);
+
+    if (!cached) {
+        if (!mesh->readFromOFF(filepath))
+            return nullptr;
+
+        if (useMeshCache)
+            MeshCache::write(filepath, *mesh);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return meshes.insert(std::make_pair(filepath, std::shared_ptr<const TriangleMesh>(mesh))).first->second;
+}
+
+int MeshLibrary::size() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return static_cast<int>(meshes.size());
+}
+
+void MeshLibrary::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    meshes.clear();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+
+#include "TriangleMesh.h"
+
+// Meshes shared between the scenes of one process: every file is read and
+// gets its BVH once, and every scene that uses it again gets the same
+// read-only mesh. Different meshes may be loaded from several threads at
+// once; the lock is not held while a mesh is read, so the same one loaded
+// twice at once is read twice and the first one read is kept.
+class MeshLibrary {
+private:
+    std::map<std::string, std::shared_ptr<const TriangleMesh>> meshes;
+    mutable std::mutex mutex;
+
+public:
+    // null (with a message on stderr) if the file cannot be read. That is
+    // not kept, the next call tries again
+    std::shared_ptr<const TriangleMesh> loadOFF(const std::string &filepath, bool useMeshCache);
+
+    int size() const;
+    void clear();
+};
@@ -0,0 +1,270 @@
+#pragma once
+
+// Small SIMD layer for tracing packets of coherent rays. The width is picked
+// at build time: 8 lanes with AVX2, 4 lanes with SSE2, and a portable 4 lane
+// fallback when SRT_NO_SIMD is defined or neither is available. All lane
+// arithmetic is plain IEEE single precision (no FMA, no approximations), so
+// a packet produces exactly the same numbers as the scalar code.
+
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#if !defined(SRT_NO_SIMD) && defined(__AVX2__)
+    #define SRT_PACKET_AVX2
+    #include <immintrin.h>
+#elif !defined(SRT_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define SRT_PACKET_SSE
+    #include <emmintrin.h>
+#else
+    #define SRT_PACKET_SCALAR
+#endif
+
+#if defined(SRT_PACKET_AVX2)
+static const int PACKET_WIDTH = 8;
+#else
+static const int PACKET_WIDTH = 4;
+#endif
+
+// true when packets map onto SIMD registers, packet tracing is only worth
+// it (and only enabled by default) in that case
+#if defined(SRT_PACKET_SCALAR)
+static const bool PACKET_SIMD = false;
+#else
+static const bool PACKET_SIMD = true;
+#endif
+
+#if defined(SRT_PACKET_AVX2)
+
+struct PacketMask {
+    __m256 m;
+
+    PacketMask() {}
+    PacketMask(__m256 v): m{v} {}
+
+    int bits() const { return _mm256_movemask_ps(m); }
+    bool any() const { return bits() != 0; }
+    bool lane(int i) const { return (bits() >> i) & 1; }
+
+    static PacketMask none() { return _mm256_setzero_ps(); }
+    static PacketMask all() { return _mm256_castsi256_ps(_mm256_set1_epi32(-1)); }
+};
+
+inline PacketMask operator&(const PacketMask &a, const PacketMask &b) { return _mm256_and_ps(a.m, b.m); }
+inline PacketMask operator|(const PacketMask &a, const PacketMask &b) { return _mm256_or_ps(a.m, b.m); }
+// a & ~b
+inline PacketMask andNot(const PacketMask &a, const PacketMask &b) { return _mm256_andnot_ps(b.m, a.m); }
+
+struct PacketFloat {
+    __m256 v;
+
+    PacketFloat() {}
+    PacketFloat(__m256 x): v{x} {}
+    PacketFloat(float s): v{_mm256_set1_ps(s)} {}
+
+    static PacketFloat load(const float *p) { return _mm256_loadu_ps(p); }
+    void store(float *p) const { _mm256_storeu_ps(p, v); }
+
+    float operator[](int i) const {
+        float lanes[PACKET_WIDTH];
+        store(lanes);
+        return lanes[i];
+    }
+};
+
+inline PacketFloat operator+(const PacketFloat &a, const PacketFloat &b) { return _mm256_add_ps(a.v, b.v); }
+inline PacketFloat operator-(const PacketFloat &a, const PacketFloat &b) { return _mm256_sub_ps(a.v, b.v); }
+inline PacketFloat operator*(const PacketFloat &a, const PacketFloat &b) { return _mm256_mul_ps(a.v, b.v); }
+inline PacketFloat operator/(const PacketFloat &a, const PacketFloat &b) { return _mm256_div_ps(a.v, b.v); }
+
+inline PacketMask operator<(const PacketFloat &a, const PacketFloat &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline PacketMask operator>(const PacketFloat &a, const PacketFloat &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline PacketMask operator<=(const PacketFloat &a, const PacketFloat &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline PacketMask operator>=(const PacketFloat &a, const PacketFloat &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline PacketMask operator==(const PacketFloat &a, const PacketFloat &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+inline PacketMask operator!=(const PacketFloat &a, const PacketFloat &b) { return _mm256_cmp_ps(a.v, b.v, _CMP_NEQ_UQ); }
+
+inline PacketFloat sqrt(const PacketFloat &a) { return _mm256_sqrt_ps(a.v); }
+inline PacketFloat abs(const PacketFloat &a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+// mask ? a : b
+inline PacketFloat select(const PacketMask &mask, const PacketFloat &a, const PacketFloat &b) { return _mm256_blendv_ps(b.v, a.v, mask.m); }
+
+#elif defined(SRT_PACKET_SSE)
+
+struct PacketMask {
+    __m128 m;
+
+    PacketMask() {}
+    PacketMask(__m128 v): m{v} {}
+
+    int bits() const { return _mm_movemask_ps(m); }
+    bool any() const { return bits() != 0; }
+    bool lane(int i) const { return (bits() >> i) & 1; }
+
+    static PacketMask none() { return _mm_setzero_ps(); }
+    static PacketMask all() { return _mm_castsi128_ps(_mm_set1_epi32(-1)); }
+};
+
+inline PacketMask operator&(const PacketMask &a, const PacketMask &b) { return _mm_and_ps(a.m, b.m); }
+inline PacketMask operator|(const PacketMask &a, const PacketMask &b) { return _mm_or_ps(a.m, b.m); }
+// a & ~b
+inline PacketMask andNot(const PacketMask &a, const PacketMask &b) { return _mm_andnot_ps(b.m, a.m); }
+
+struct PacketFloat {
+    __m128 v;
+
+    PacketFloat() {}
+    PacketFloat(__m128 x): v{x} {}
+    PacketFloat(float s): v{_mm_set1_ps(s)} {}
+
+    static PacketFloat load(const float *p) { return _mm_loadu_ps(p); }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    float operator[](int i) const {
+        float lanes[PACKET_WIDTH];
+        store(lanes);
+        return lanes[i];
+    }
+};
+
+inline PacketFloat operator+(const PacketFloat &a, const PacketFloat &b) { return _mm_add_ps(a.v, b.v); }
+inline PacketFloat operator-(const PacketFloat &a, const PacketFloat &b) { return _mm_sub_ps(a.v, b.v); }
+inline PacketFloat operator*(const PacketFloat &a, const PacketFloat &b) { return _mm_mul_ps(a.v, b.v); }
+inline PacketFloat operator/(const PacketFloat &a, const PacketFloat &b) { return _mm_div_ps(a.v, b.v); }
+
+inline PacketMask operator<(const PacketFloat &a, const PacketFloat &b) { return _mm_cmplt_ps(a.v, b.v); }
+inline PacketMask operator>(const PacketFloat &a, const PacketFloat &b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline PacketMask operator<=(const PacketFloat &a, const PacketFloat &b) { return _mm_cmple_ps(a.v, b.v); }
+inline PacketMask operator>=(const PacketFloat &a, const PacketFloat &b) { return _mm_cmpge_ps(a.v, b.v); }
+inline PacketMask operator==(const PacketFloat &a, const PacketFloat &b) { return _mm_cmpeq_ps(a.v, b.v); }
+inline PacketMask operator!=(const PacketFloat &a, const PacketFloat &b) { return _mm_cmpneq_ps(a.v, b.v); }
+
+inline PacketFloat sqrt(const PacketFloat &a) { return _mm_sqrt_ps(a.v); }
+inline PacketFloat abs(const PacketFloat &a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+// mask ? a : b
+inline PacketFloat select(const PacketMask &mask, const PacketFloat &a, const PacketFloat &b) {
+    return _mm_or_ps(_mm_and_ps(mask.m, a.v), _mm_andnot_ps(mask.m, b.v));
+}
+
+#else
+
+struct PacketMask {
+    bool m[PACKET_WIDTH];
+
+    int bits() const {
+        int b = 0;
+        for (int i = 0; i < PACKET_WIDTH; i++)
+            b |= m[i] << i;
+        return b;
+    }
+
+    bool any() const { return bits() != 0; }
+    bool lane(int i) const { return m[i]; }
+
+    static PacketMask none() { PacketMask r; for (int i = 0; i < PACKET_WIDTH; i++) r.m[i] = false; return r; }
+    static PacketMask all() { PacketMask r; for (int i = 0; i < PACKET_WIDTH; i++) r.m[i] = true; return r; }
+};
+
+inline PacketMask operator&(const PacketMask &a, const PacketMask &b) { PacketMask r; for (int i = 0; i < PACKET_WIDTH; i++) r.m[i] = a.m[i] && b.m[i]; return r; }
+inline PacketMask operator|(const PacketMask &a, const PacketMask &b) { PacketMask r; for (int i = 0; i < PACKET_WIDTH; i++) r.m[i] = a.m[i] || b.m[i]; return r; }
+// a & ~b
+inline PacketMask andNot(const PacketMask &a, const PacketMask &b) { PacketMask r; for (int i = 0; i < PACKET_WIDTH; i++) r.m[i] = a.m[i] && !b.m[i]; return r; }
+
+struct PacketFloat {
+    float v[PACKET_WIDTH];
+
+    PacketFloat() {}
+    PacketFloat(float s) { for (int i = 0; i < PACKET_WIDTH; i++) v[i] = s; }
+
+    static PacketFloat load(const float *p) { PacketFloat r; for (int i = 0; i < PACKET_WIDTH; i++) r.v[i] = p[i]; return r; }
+    void store(float *p) const { for (int i = 0; i < PACKET_WIDTH; i++) p[i] = v[i]; }
+
+    float operator[](int i) const { return v[i]; }
+};
+
+#define SRT_PACKET_BINARY_OP(op) \
+    inline PacketFloat operator op(const PacketFloat &a, const PacketFloat &b) { \
+        PacketFloat r; for (int i = 0; i < PACKET_WIDTH; i++) r.v[i] = a.v[i] op b.v[i]; return r; }
+#define SRT_PACKET_COMPARE_OP(op) \
+    inline PacketMask operator op(const PacketFloat &a, const PacketFloat &b) { \
+        PacketMask r; for (int i = 0; i < PACKET_WIDTH; i++) r.m[i] = a.v[i] op b.v[i]; return r; }
+
+SRT_PACKET_BINARY_OP(+)
+SRT_PACKET_BINARY_OP(-)
+SRT_PACKET_BINARY_OP(*)
+SRT_PACKET_BINARY_OP(/)
+SRT_PACKET_COMPARE_OP(<)
+SRT_PACKET_COMPARE_OP(>)
+SRT_PACKET_COMPARE_OP(<=)
+SRT_PACKET_COMPARE_OP(>=)
+SRT_PACKET_COMPARE_OP(==)
+SRT_PACKET_COMPARE_OP(!=)
+
+#undef SRT_PACKET_BINARY_OP
+#undef SRT_PACKET_COMPARE_OP
+
+inline PacketFloat sqrt(const PacketFloat &a) { PacketFloat r; for (int i = 0; i < PACKET_WIDTH; i++) r.v[i] = std::sqrt(a.v[i]); return r; }
+inline PacketFloat abs(const PacketFloat &a) { PacketFloat r; for (int i = 0; i < PACKET_WIDTH; i++) r.v[i] = std::fabs(a.v[i]); return r; }
+// mask ? a : b
+inline PacketFloat select(const PacketMask &mask, const PacketFloat &a, const PacketFloat &b) {
+    PacketFloat r;
+    for (int i = 0; i < PACKET_WIDTH; i++)
+        r.v[i] = mask.m[i] ? a.v[i] : b.v[i];
+    return r;
+}
+
+#endif
+
+// packet of rays sharing one origin (e.g. primary rays from the eye)
+struct RayPacket {
+    glm::vec3 e;
+    PacketFloat dx, dy, dz;
+    PacketFloat invDx, invDy, invDz;
+    PacketMask active;
+
+    glm::vec3 direction(int i) const {
+        return glm::vec3(dx[i], dy[i], dz[i]);
+    }
+};
+
+// nearest hit found so far for every lane of a packet, normals are only
+// computed afterwards for the hits that survive
+struct PacketHit {
+    PacketFloat t;             // upper end of the search range for lanes without a hit
+    int idx[PACKET_WIDTH];     // -1 for lanes without a hit
+    int prim[PACKET_WIDTH];    // triangle within a mesh, -1 for other objects
+
+    // takes t for the lanes in candidate where it is nearer than the current
+    // hit, or equally near with a lower id, exactly like the scalar query.
+    // Returns the bits of the lanes that were updated
+    int update(const PacketMask &candidate, const PacketFloat &tNew, int id) {
+        int closer = (candidate & (tNew < t)).bits();
+        int ties = (candidate & (tNew == t)).bits();
+
+        for (int i = 0; i < PACKET_WIDTH; i++) {
+            if (((ties >> i) & 1) && idx[i] > id)
+                closer |= 1 << i;
+        }
+
+        if (closer == 0)
+            return 0;
+
+        t = select(laneMask(closer), tNew, t);
+
+        for (int i = 0; i < PACKET_WIDTH; i++) {
+            if ((closer >> i) & 1) {
+                idx[i] = id;
+                prim[i] = -1;
+            }
+        }
+
+        return closer;
+    }
+
+    static PacketMask laneMask(int bits) {
+        float lanes[PACKET_WIDTH];
+        for (int i = 0; i < PACKET_WIDTH; i++)
+            lanes[i] = ((bits >> i) & 1) ? 1.0f : 0.0f;
+        return PacketFloat::load(lanes) != PacketFloat(0.0f);
+    }
+};
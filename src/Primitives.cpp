@@ -0,0 +1,483 @@
+#include "Primitives.h"
+
+#include <cmath>
+#include <utility>
+#include <algorithm>
+
+// scratch takes the old values, so the next component is permuted into
+// the same memory instead of a new allocation
+static void permute(std::vector<float> &values, const std::vector<int> &order, std::vector<float> &scratch) {
+    scratch.resize(values.size());
+
+    for (unsigned k = 0; k < order.size(); k++)
+        scratch[k] = values[order[k]];
+    // anything past order (padding) is zero
+    std::fill(scratch.begin() + order.size(), scratch.end(), 0.0f);
+
+    values.swap(scratch);
+}
+
+int PlaneArray::size() const {
+    return static_cast<int>(pointX.size());
+}
+
+int PlaneArray::add(const glm::vec3 &point, const glm::vec3 &normal) {
+    pointX.push_back(point.x);
+    pointY.push_back(point.y);
+    pointZ.push_back(point.z);
+    normalX.push_back(normal.x);
+    normalY.push_back(normal.y);
+    normalZ.push_back(normal.z);
+
+    return size() - 1;
+}
+
+glm::vec3 PlaneArray::point(int i) const {
+    return glm::vec3(pointX[i], pointY[i], pointZ[i]);
+}
+
+glm::vec3 PlaneArray::normal(int i) const {
+    return glm::vec3(normalX[i], normalY[i], normalZ[i]);
+}
+
+bool PlaneArray::intersect(int i,
+                           const glm::vec3 &e,
+                           const glm::vec3 &d,
+                           float t0,
+                           float &t) const {
+
+    glm::vec3 n = normal(i);
+    float denom = glm::dot(d, n);
+
+    if (fabs(denom) > 0) {
+        glm::vec3 diff = point(i) - e;
+        float this_t = glm::dot(diff, n)/denom;
+
+        if (this_t > t0) {
+            t = this_t;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+PacketMask PlaneArray::intersect(int i, const RayPacket &rays, float t0, PacketFloat &t) const {
+    glm::vec3 n = normal(i);
+    PacketFloat denom = rays.dx * n.x + rays.dy * n.y + rays.dz * n.z;
+
+    glm::vec3 diff = point(i) - rays.e;
+    t = PacketFloat(glm::dot(diff, n)) / denom;
+
+    return rays.active & (abs(denom) > 0.0f) & (t > t0);
+}
+
+bool PlaneArray::occluded(int i, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const {
+    float t;
+    return intersect(i, e, d, t0, t) && t < t1;
+}
+
+int SphereArray::size() const {
+    return static_cast<int>(radius.size());
+}
+
+int SphereArray::add(const glm::vec3 &center, float r) {
+    centerX.push_back(center.x);
+    centerY.push_back(center.y);
+    centerZ.push_back(center.z);
+    radius.push_back(r);
+
+    return size() - 1;
+}
+
+void SphereArray::reorder(const std::vector<int> &order) {
+    std::vector<float> scratch;
+
+    for (std::vector<float> *v : { &centerX, &centerY, &centerZ, &radius })
+        permute(*v, order, scratch);
+}
+
+glm::vec3 SphereArray::center(int i) const {
+    return glm::vec3(centerX[i], centerY[i], centerZ[i]);
+}
+
+glm::vec3 SphereArray::normal(int i, const glm::vec3 &hit) const {
+    return glm::normalize(hit - center(i));
+}
+
+void SphereArray::getBounds(int i, AABB &box) const {
+    box = AABB(center(i) - glm::vec3(radius[i]), center(i) + glm::vec3(radius[i]));
+}
+
+// The roots are found as in "Precision Improvements for Ray/Sphere
+// Intersection" (Haines et al., Ray Tracing Gems): the discriminant from the
+// distance between the center and the line instead of B^2 - 4AC, and the
+// root nearer to the origin as C / q instead of a difference of two almost
+// equal numbers. A ray leaving the surface then gets a root close to 0 that
+// is on the right side of it, rather than one off by the rounding of B^2
+bool SphereArray::intersect(int i,
+                            const glm::vec3 &e,
+                            const glm::vec3 &d,
+                            float t0,
+                            float &t) const {
+
+    glm::vec3 f = e - center(i);
+    float r = radius[i];
+
+    float A = d.x * d.x + d.y * d.y + d.z * d.z;
+    float b = -1.0f * (d.x * f.x + d.y * f.y + d.z * f.z);
+    float C = f.x * f.x + f.y * f.y + f.z * f.z - r * r;
+
+    // f + (b / A) d is the point of the line nearest to the center
+    float invA = 1.0f / A;
+    float s = b * invA;
+    float lx = f.x + s * d.x;
+    float ly = f.y + s * d.y;
+    float lz = f.z + s * d.z;
+
+    float discriminant = r * r - (lx * lx + ly * ly + lz * lz);
+
+    if (discriminant < 0.0f)
+        return false;
+
+    float root = std::sqrt(A * discriminant);
+    float q = b < 0.0f ? b - root : b + root;
+
+    float ta = C / q;
+    float tb = q * invA;
+    float nearer = tb < ta ? tb : ta;
+    float farther = tb < ta ? ta : tb;
+
+    t = nearer > t0 ? nearer : farther;
+    return t > t0;
+}
+
+PacketMask SphereArray::intersect(int i, const RayPacket &rays, float t0, PacketFloat &t) const {
+    // same operations in the same order as the scalar test
+    glm::vec3 f = rays.e - center(i);
+    float r = radius[i];
+
+    PacketFloat A = rays.dx * rays.dx + rays.dy * rays.dy + rays.dz * rays.dz;
+    PacketFloat b = -1.0f * (rays.dx * f.x + rays.dy * f.y + rays.dz * f.z);
+    float C = f.x * f.x + f.y * f.y + f.z * f.z - r * r;
+
+    PacketFloat invA = 1.0f / A;
+    PacketFloat s = b * invA;
+    PacketFloat lx = f.x + s * rays.dx;
+    PacketFloat ly = f.y + s * rays.dy;
+    PacketFloat lz = f.z + s * rays.dz;
+
+    PacketFloat discriminant = r * r - (lx * lx + ly * ly + lz * lz);
+    PacketMask mask = andNot(rays.active, discriminant < 0.0f);
+
+    if (!mask.any())
+        return mask;
+
+    PacketFloat root = sqrt(A * discriminant);
+    PacketFloat q = select(b < 0.0f, b - root, b + root);
+
+    PacketFloat ta = PacketFloat(C) / q;
+    PacketFloat tb = q * invA;
+    PacketFloat nearer = select(tb < ta, tb, ta);
+    PacketFloat farther = select(tb < ta, ta, tb);
+
+    t = select(nearer > t0, nearer, farther);
+    return mask & (t > t0);
+}
+
+bool SphereArray::occluded(int i, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const {
+    float t;
+    return intersect(i, e, d, t0, t) && t < t1;
+}
+
+TriangleArray::TriangleArray()
+        : count{0}
+        , attached{false} {
+    resize(0);
+}
+
+TriangleArray::TriangleArray(const TriangleArray &other)
+        : count{0}
+        , attached{false} {
+    *this = other;
+}
+
+TriangleArray::TriangleArray(TriangleArray &&other)
+        : count{0}
+        , attached{false} {
+    *this = std::move(other);
+}
+
+TriangleArray &TriangleArray::operator=(const TriangleArray &other) {
+    for (int k = 0; k < NUM_COMPONENTS; k++)
+        owned[k] = other.owned[k];
+
+    count = other.count;
+    attached = other.attached;
+
+    // attached memory is shared, owned memory is not
+    if (attached) {
+        const float **arrays[NUM_COMPONENTS];
+        views(arrays);
+        for (int k = 0; k < NUM_COMPONENTS; k++)
+            *arrays[k] = other.component(k);
+    } else {
+        point();
+    }
+
+    return *this;
+}
+
+TriangleArray &TriangleArray::operator=(TriangleArray &&other) {
+    if (this == &other)
+        return *this;
+
+    for (int k = 0; k < NUM_COMPONENTS; k++)
+        owned[k].swap(other.owned[k]);
+
+    count = other.count;
+    attached = other.attached;
+
+    const float **arrays[NUM_COMPONENTS];
+    views(arrays);
+    for (int k = 0; k < NUM_COMPONENTS; k++)
+        *arrays[k] = other.component(k);
+
+    other.clear();
+    return *this;
+}
+
+void TriangleArray::views(const float **arrays[NUM_COMPONENTS]) {
+    const float **all[NUM_COMPONENTS] = {
+        &ax, &ay, &az, &e1x, &e1y, &e1z, &e2x, &e2y, &e2z, &normalX, &normalY, &normalZ
+    };
+
+    std::copy(all, all + NUM_COMPONENTS, arrays);
+}
+
+void TriangleArray::point() {
+    const float **arrays[NUM_COMPONENTS];
+    views(arrays);
+
+    for (int k = 0; k < NUM_COMPONENTS; k++)
+        *arrays[k] = owned[k].data();
+}
+
+size_t TriangleArray::paddedSize(int n) {
+    // PACKET_WIDTH - 1 zero triangles (e1 = e2 = 0, never hit) at the end,
+    // so intersectRange can load a full packet starting at any triangle
+    return static_cast<size_t>(n) + PACKET_WIDTH - 1;
+}
+
+void TriangleArray::resize(int n) {
+    for (std::vector<float> &v : owned)
+        v.resize(paddedSize(n), 0.0f);
+
+    count = n;
+    attached = false;
+    point();
+}
+
+int TriangleArray::size() const {
+    return count;
+}
+
+void TriangleArray::clear() {
+    for (std::vector<float> &v : owned)
+        v.clear();
+
+    resize(0);
+}
+
+int TriangleArray::add(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    int i = count;
+    resize(count + 1);
+    set(i, a, b, c);
+    return i;
+}
+
+void TriangleArray::set(int i, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c) {
+    glm::vec3 e1 = b - a;
+    glm::vec3 e2 = c - a;
+    glm::vec3 n = glm::normalize(glm::cross(e2, e1));
+
+    const float values[NUM_COMPONENTS] = {
+        a.x, a.y, a.z, e1.x, e1.y, e1.z, e2.x, e2.y, e2.z, n.x, n.y, n.z
+    };
+
+    for (int k = 0; k < NUM_COMPONENTS; k++)
+        owned[k][i] = values[k];
+}
+
+void TriangleArray::reorder(const std::vector<int> &order) {
+    std::vector<float> scratch;
+
+    for (std::vector<float> &v : owned)
+        permute(v, order, scratch);
+
+    point();
+}
+
+const float *TriangleArray::component(int k) const {
+    const float *const all[NUM_COMPONENTS] = {
+        ax, ay, az, e1x, e1y, e1z, e2x, e2y, e2z, normalX, normalY, normalZ
+    };
+
+    return all[k];
+}
+
+void TriangleArray::attach(const float *data, int n) {
+    for (std::vector<float> &v : owned)
+        std::vector<float>().swap(v);
+
+    const float **arrays[NUM_COMPONENTS];
+    views(arrays);
+
+    for (int k = 0; k < NUM_COMPONENTS; k++)
+        *arrays[k] = data + k * paddedSize(n);
+
+    count = n;
+    attached = true;
+}
+
+glm::vec3 TriangleArray::normal(int i) const {
+    return glm::vec3(normalX[i], normalY[i], normalZ[i]);
+}
+
+void TriangleArray::getBounds(int i, AABB &box) const {
+    glm::vec3 a(ax[i], ay[i], az[i]);
+
+    box = AABB();
+    box.expand(a);
+    box.expand(a + glm::vec3(e1x[i], e1y[i], e1z[i]));
+    box.expand(a + glm::vec3(e2x[i], e2y[i], e2z[i]));
+}
+
+bool TriangleArray::intersect(int i,
+                              const glm::vec3 &e,
+                              const glm::vec3 &d,
+                              float t0,
+                              float &t) const {
+
+    glm::vec3 e1(e1x[i], e1y[i], e1z[i]);
+    glm::vec3 e2(e2x[i], e2y[i], e2z[i]);
+
+    glm::vec3 pvec = glm::cross(d, e2);
+    float det = glm::dot(e1, pvec);
+
+    // ray parallel to the plane (or degenerate triangle). There is no epsilon
+    // band around 0 and the edge tests below are inclusive, so a ray through
+    // an edge shared by two triangles is never rejected by both of them
+    if (det == 0.0f)
+        return false;
+
+    float invDet = 1.0f / det;
+
+    glm::vec3 tvec = e - glm::vec3(ax[i], ay[i], az[i]);
+    float beta = glm::dot(tvec, pvec) * invDet;
+
+    if (beta < 0.0f || beta > 1.0f)
+        return false;
+
+    glm::vec3 qvec = glm::cross(tvec, e1);
+    float gamma = glm::dot(d, qvec) * invDet;
+
+    if (gamma < 0.0f || beta + gamma > 1.0f)
+        return false;
+
+    t = glm::dot(e2, qvec) * invDet;
+    return t > t0;
+}
+
+PacketMask TriangleArray::intersect(int i, const RayPacket &rays, float t0, PacketFloat &t) const {
+    glm::vec3 e1(e1x[i], e1y[i], e1z[i]);
+    glm::vec3 e2(e2x[i], e2y[i], e2z[i]);
+
+    // the origin is shared, so tvec and qvec are the same for every lane
+    glm::vec3 tvec = rays.e - glm::vec3(ax[i], ay[i], az[i]);
+    glm::vec3 qvec = glm::cross(tvec, e1);
+
+    PacketFloat px = rays.dy * e2.z - rays.dz * e2.y;
+    PacketFloat py = rays.dz * e2.x - rays.dx * e2.z;
+    PacketFloat pz = rays.dx * e2.y - rays.dy * e2.x;
+
+    PacketFloat det = e1.x * px + e1.y * py + e1.z * pz;
+    PacketFloat invDet = 1.0f / det;
+
+    PacketFloat beta = (tvec.x * px + tvec.y * py + tvec.z * pz) * invDet;
+    PacketFloat gamma = (rays.dx * qvec.x + rays.dy * qvec.y + rays.dz * qvec.z) * invDet;
+
+    t = PacketFloat(glm::dot(e2, qvec)) * invDet;
+
+    // phrased as rejections, like the scalar test, so NaNs behave the same
+    PacketMask rejected = (beta < 0.0f) | (beta > 1.0f) | (gamma < 0.0f) | (beta + gamma > 1.0f);
+
+    return andNot(rays.active & (det != 0.0f) & (t > t0), rejected);
+}
+
+int TriangleArray::intersectRange(int first,
+                                  int n,
+                                  const glm::vec3 &e,
+                                  const glm::vec3 &d,
+                                  float t0,
+                                  PacketFloat &t) const {
+
+    // the single triangle test with the triangles spread over the lanes,
+    // operands in the same order so every lane rounds the same way
+    PacketFloat e1X = PacketFloat::load(&e1x[first]);
+    PacketFloat e1Y = PacketFloat::load(&e1y[first]);
+    PacketFloat e1Z = PacketFloat::load(&e1z[first]);
+    PacketFloat e2X = PacketFloat::load(&e2x[first]);
+    PacketFloat e2Y = PacketFloat::load(&e2y[first]);
+    PacketFloat e2Z = PacketFloat::load(&e2z[first]);
+
+    // pvec = cross(d, e2)
+    PacketFloat px = d.y * e2Z - e2Y * d.z;
+    PacketFloat py = d.z * e2X - e2Z * d.x;
+    PacketFloat pz = d.x * e2Y - e2X * d.y;
+
+    PacketFloat det = e1X * px + e1Y * py + e1Z * pz;
+    PacketFloat invDet = 1.0f / det;
+
+    PacketFloat tx = e.x - PacketFloat::load(&ax[first]);
+    PacketFloat ty = e.y - PacketFloat::load(&ay[first]);
+    PacketFloat tz = e.z - PacketFloat::load(&az[first]);
+
+    PacketFloat beta = (tx * px + ty * py + tz * pz) * invDet;
+
+    // qvec = cross(tvec, e1)
+    PacketFloat qx = ty * e1Z - e1Y * tz;
+    PacketFloat qy = tz * e1X - e1Z * tx;
+    PacketFloat qz = tx * e1Y - e1X * ty;
+
+    PacketFloat gamma = (d.x * qx + d.y * qy + d.z * qz) * invDet;
+
+    t = (e2X * qx + e2Y * qy + e2Z * qz) * invDet;
+
+    PacketMask rejected = (beta < 0.0f) | (beta > 1.0f) | (gamma < 0.0f) | (beta + gamma > 1.0f);
+
+    return andNot((det != 0.0f) & (t > t0), rejected).bits() & ((1 << n) - 1);
+}
+
+bool TriangleArray::occluded(int i, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const {
+    float t;
+    return intersect(i, e, d, t0, t) && t < t1;
+}
+
+bool TriangleArray::occludedRange(int first, int n, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const {
+    if (!PACKET_SIMD) {
+        for (int i = first; i < first + n; i++) {
+            if (occluded(i, e, d, t0, t1))
+                return true;
+        }
+        return false;
+    }
+
+    PacketFloat t;
+    int hits = intersectRange(first, n, e, d, t0, t);
+
+    if (hits == 0)
+        return false;
+
+    return (hits & (t < t1).bits()) != 0;
+}
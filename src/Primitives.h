@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "AABB.h"
+#include "Packet.h"
+
+#include <glm/glm.hpp>
+
+// Primitives of one type in structure-of-arrays layout: each component
+// (center.x, radius, ...) of every primitive sits in its own contiguous
+// vector and primitive i is the i-th entry of all of them. The scene keeps
+// one array per type and dispatches on the type, so there is no per object
+// allocation, vtable or material pointer.
+//
+// The intersection kernels only produce t. Normals are computed once for the
+// nearest hit, not for every candidate.
+
+class PlaneArray {
+public:
+    std::vector<float> pointX, pointY, pointZ;
+    std::vector<float> normalX, normalY, normalZ;
+
+    int size() const;
+    int add(const glm::vec3 &point, const glm::vec3 &normal);
+
+    glm::vec3 point(int i) const;
+    glm::vec3 normal(int i) const;
+
+    // hits with t > t0 only
+    bool intersect(int i, const glm::vec3 &e, const glm::vec3 &d, float t0, float &t) const;
+    PacketMask intersect(int i, const RayPacket &rays, float t0, PacketFloat &t) const;
+    // any hit with t in (t0, t1)
+    bool occluded(int i, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const;
+};
+
+class SphereArray {
+public:
+    std::vector<float> centerX, centerY, centerZ;
+    std::vector<float> radius;
+
+    int size() const;
+    int add(const glm::vec3 &center, float r);
+    // element k becomes the old element order[k]
+    void reorder(const std::vector<int> &order);
+
+    glm::vec3 center(int i) const;
+    glm::vec3 normal(int i, const glm::vec3 &hit) const;
+    void getBounds(int i, AABB &box) const;
+
+    // nearest root beyond t0: the nearer one, or the farther one when the
+    // nearer one is at or before t0 (a ray that starts inside)
+    bool intersect(int i, const glm::vec3 &e, const glm::vec3 &d, float t0, float &t) const;
+    PacketMask intersect(int i, const RayPacket &rays, float t0, PacketFloat &t) const;
+    // that root in (t0, t1)
+    bool occluded(int i, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const;
+};
+
+class TriangleArray {
+public:
+    static const int NUM_COMPONENTS = 12;
+
+private:
+    int count;
+    bool attached;  // the components are someone else's memory, see attach()
+
+    // the components when the array owns them, in the order of the
+    // pointers below
+    std::vector<float> owned[NUM_COMPONENTS];
+
+    void views(const float **arrays[NUM_COMPONENTS]);
+    // points every component at owned
+    void point();
+
+public:
+    // read by every test
+    const float *ax, *ay, *az;
+    const float *e1x, *e1y, *e1z;    // b - a
+    const float *e2x, *e2y, *e2z;    // c - a
+    // only read for the nearest hit
+    const float *normalX, *normalY, *normalZ;
+
+    TriangleArray();
+    TriangleArray(const TriangleArray &other);
+    TriangleArray(TriangleArray &&other);
+    TriangleArray &operator=(const TriangleArray &other);
+    TriangleArray &operator=(TriangleArray &&other);
+
+    // floats per component for n triangles, with the padding of resize()
+    static size_t paddedSize(int n);
+
+    int size() const;
+    void clear();
+    // new triangles are all zero until set
+    void resize(int n);
+    int add(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c);
+    void set(int i, const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c);
+    // element k becomes the old element order[k]
+    void reorder(const std::vector<int> &order);
+
+    // component k (in the order of the pointers above), paddedSize(size())
+    // floats
+    const float *component(int k) const;
+    // uses n triangles stored at data as NUM_COMPONENTS components of
+    // paddedSize(n) floats, one after the other, without copying them. data
+    // has to outlive the array and its copies, and nothing can be added or
+    // set afterwards (resize() and clear() give it arrays of its own again)
+    void attach(const float *data, int n);
+
+    glm::vec3 normal(int i) const;
+    void getBounds(int i, AABB &box) const;
+
+    // Moller-Trumbore test, only produces t and only hits with t > t0
+    bool intersect(int i, const glm::vec3 &e, const glm::vec3 &d, float t0, float &t) const;
+    // every lane of the packet against triangle i
+    PacketMask intersect(int i, const RayPacket &rays, float t0, PacketFloat &t) const;
+    // one ray against triangles first ... first + n - 1 (n <= PACKET_WIDTH)
+    // in the lanes of t, returns the bits of the lanes that are hit. Gives
+    // the same t as the single triangle test
+    int intersectRange(int first, int n, const glm::vec3 &e, const glm::vec3 &d, float t0, PacketFloat &t) const;
+
+    // any hit with t in (t0, t1)
+    bool occluded(int i, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const;
+    // the same for any of triangles first ... first + n - 1 (n <= PACKET_WIDTH)
+    bool occludedRange(int first, int n, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const;
+};
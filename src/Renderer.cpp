@@ -0,0 +1,1146 @@
+#include "Renderer.h"
+
+#include <cmath>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+
+#include "Stats.h"
+#include "TileScheduler.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+static const int MAXRECURSION = 3;
+static const int TILE_SIZE = 32;
+// pixel footprint of a packet, 4x2 for 8 lanes and 2x2 for 4
+static const int PACKET_COLS = PACKET_WIDTH == 8 ? 4 : 2;
+static const int PACKET_ROWS = PACKET_WIDTH / PACKET_COLS;
+// anti-aliasing: largest grid per pixel, and the color difference
+// between the first samples of a pixel above which it gets the full grid
+static const int AA_MAX_SAMPLES = 16;
+static const float AA_THRESHOLD = 1.0f / 32.0f;
+// bound on the error of each coordinate of a hit point e + t d, relative
+// to |e| + |t d| of that coordinate. Covers the rounding of t by the
+// intersection tests as well as that of e + t d
+static const float HIT_ERROR = 1.0f / 262144.0f;
+// point lights from which on the light tree is cut, and the most clusters
+// a cut may end up with
+static const int LIGHT_TREE_MIN_LIGHTS = 256;
+static const int LIGHT_CUT_MAX = 512;
+static const float FLOAT_INF = std::numeric_limits<float>::infinity();
+
+static std::atomic<unsigned long long> nextGeneration(1);
+
+Renderer::Renderer(Scene &s, int w, int h)
+        : scene{s}
+        , width{w}
+        , height{h}
+        , focalLength{s.camera.getFocalLength()}
+        , eye{s.camera.getPosition()}
+        , invView{glm::inverse(s.camera.getViewMatrix())}
+        , invProj{glm::inverse(s.camera.getProjectionMatrix())}
+        , packetTracing{PACKET_SIMD}
+        , wavefrontTracing{false}
+        , minThroughput{0.0f}
+        , aaSamples{1}
+        , lights{}
+        , lightCutoff{0.0f}
+        , lightError{DEFAULT_LIGHT_ERROR}
+        , generation{nextGeneration++}
+        , aovsEnabled{false}
+        , counts{ 0, 0, 0 } {
+    lights.build(s.lights);
+}
+
+void Renderer::setPacketTracing(bool enabled) {
+    packetTracing = enabled;
+}
+
+void Renderer::setAntialiasing(int samplesPerSide) {
+    aaSamples = std::max(1, std::min(samplesPerSide, AA_MAX_SAMPLES));
+}
+
+void Renderer::setWavefront(bool enabled, float minThroughput) {
+    wavefrontTracing = enabled;
+    this->minThroughput = std::max(0.0f, minThroughput);
+}
+
+void Renderer::setLightCulling(float cutoff, float maxError) {
+    lightCutoff = std::max(0.0f, cutoff);
+    lightError = std::max(0.0f, maxError);
+}
+
+void Renderer::setAOVs(bool enabled) {
+    aovsEnabled = enabled;
+}
+
+bool Renderer::useLightTree() const {
+    return lightError > 0.0f && static_cast<int>(lights.points.size()) >= LIGHT_TREE_MIN_LIGHTS;
+}
+
+long long Renderer::render(std::vector<glm::vec4> &pixels, WorkerPool &workers) const {
+    pixels.assign(static_cast<size_t>(width) * height, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    resetAOVs(pixels.size());
+
+    if (STATS_ENABLED)
+        costs.assign(pixels.size(), 0.0f);
+
+    RenderPass pass = { 1, 0, 0, height };
+    return renderPass(pass, pixels, workers);
+}
+
+long long Renderer::renderBands(WorkerPool &workers,
+                                int bandRows,
+                                const std::function<void(int, int, const std::vector<glm::vec4>&)> &bandDone) const {
+
+    // bands of whole tiles get the same tiles as render()
+    bandRows = std::max(1, (bandRows + TILE_SIZE - 1) / TILE_SIZE) * TILE_SIZE;
+
+    if (STATS_ENABLED)
+        costs.assign(static_cast<size_t>(width) * height, 0.0f);
+
+    std::vector<glm::vec4> pixels;
+    long long numRays = 0;
+
+    for (int y0 = 0; y0 < height; y0 += bandRows) {
+        RenderPass pass = { 1, 0, y0, std::min(y0 + bandRows, height) };
+
+        pixels.assign(static_cast<size_t>(width) * (pass.y1 - pass.y0), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+        resetAOVs(pixels.size());
+        numRays += renderPass(pass, pixels, workers);
+
+        bandDone(pass.y0, pass.y1, pixels);
+    }
+
+    return numRays;
+}
+
+long long Renderer::renderProgressive(std::vector<glm::vec4> &pixels,
+                                      WorkerPool &workers,
+                                      int firstStep,
+                                      const std::function<void(int, int)> &passDone) const {
+
+    pixels.assign(static_cast<size_t>(width) * height, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    resetAOVs(pixels.size());
+
+    if (STATS_ENABLED)
+        costs.assign(pixels.size(), 0.0f);
+
+    // tiles have to start on the grid of every pass
+    firstStep = std::max(1, std::min(firstStep, TILE_SIZE));
+
+    int numPasses = 1;
+    while ((1 << numPasses) <= firstStep)
+        numPasses++;
+
+    RenderPass pass = { 1 << (numPasses - 1), 0, 0, height };
+    long long numRays = 0;
+
+    for (int k = 0; k < numPasses; k++) {
+        numRays += renderPass(pass, pixels, workers);
+        passDone(k, numPasses);
+
+        pass.skip = pass.step;
+        pass.step /= 2;
+    }
+
+    return numRays;
+}
+
+RayCounts Renderer::rayCounts() const {
+    return counts;
+}
+
+const std::vector<float> &Renderer::pixelCosts() const {
+    return costs;
+}
+
+const AOVBuffers &Renderer::aovs() const {
+    return aovBuffers;
+}
+
+void Renderer::resetAOVs(size_t numPixels) const {
+    if (!aovsEnabled)
+        return;
+
+    aovBuffers.coverage.assign(numPixels, 0.0f);
+    aovBuffers.depth.assign(numPixels, 0.0f);
+    aovBuffers.objectId.assign(numPixels, -1);
+}
+
+// work counted on this thread so far, constant without SRT_INSTRUMENT so
+// that the cost bookkeeping compiles away
+static long long currentWork() {
+    return STATS_ENABLED ? Stats::local().work() : 0;
+}
+
+// secondary rays traced on this thread, renderPass collects them per tile
+static thread_local RayCounts threadRays = { 0, 0, 0 };
+
+long long Renderer::renderPass(const RenderPass &pass, std::vector<glm::vec4> &pixels, WorkerPool &workers) const {
+    std::atomic<long long> numRays(0);
+    std::atomic<long long> numShadowRays(0);
+    std::atomic<long long> numReflectionRays(0);
+
+    TileScheduler scheduler(width, pass.y1 - pass.y0, TILE_SIZE);
+    scheduler.run(workers, [&](const Tile &bandTile) {
+        RayCounts before = threadRays;
+
+        Tile tile = bandTile;
+        tile.y0 += pass.y0;
+        tile.y1 += pass.y0;
+
+        if (aaSamples > 1)
+            numRays += renderTileAntialiased(tile.x0, tile.y0, tile.x1, tile.y1, pass, pixels);
+        else if (wavefrontTracing)
+            numRays += renderTileWavefront(tile.x0, tile.y0, tile.x1, tile.y1, pass, pixels);
+        else if (packetTracing)
+            numRays += renderTilePackets(tile.x0, tile.y0, tile.x1, tile.y1, pass, pixels);
+        else
+            numRays += renderTile(tile.x0, tile.y0, tile.x1, tile.y1, pass, pixels);
+
+        numShadowRays += threadRays.shadow - before.shadow;
+        numReflectionRays += threadRays.reflection - before.reflection;
+
+        if (STATS_ENABLED)
+            Stats::flush();
+    });
+
+    counts.primary += numRays;
+    counts.shadow += numShadowRays;
+    counts.reflection += numReflectionRays;
+
+    return numRays;
+}
+
+glm::vec3 offsetRayOrigin(const glm::vec3 &hit, const glm::vec3 &n, const glm::vec3 &error, const glm::vec3 &w) {
+    // as far along n as the error reaches in that direction. The error is
+    // at least 32 ulps of the hit, so the move is not lost to rounding
+    float distance = std::fabs(n.x) * error.x + std::fabs(n.y) * error.y + std::fabs(n.z) * error.z;
+    if (glm::dot(n, w) < 0.0f)
+        distance = -distance;
+
+    return hit + distance * n;
+}
+
+static glm::vec3 hitError(const glm::vec3 &e, const glm::vec3 &d, float t) {
+    glm::vec3 td = t * d;
+
+    return HIT_ERROR * glm::vec3(std::fabs(e.x) + std::fabs(td.x),
+                                 std::fabs(e.y) + std::fabs(td.y),
+                                 std::fabs(e.z) + std::fabs(td.z));
+}
+
+static bool tracedBefore(int i, int j, const RenderPass &pass) {
+    return pass.skip > 0 && i % pass.skip == 0 && j % pass.skip == 0;
+}
+
+void Renderer::fillBlock(int i, int j, const RenderPass &pass, int x1, int y1, const glm::vec4 &color, std::vector<glm::vec4> &pixels) const {
+    for (int y = j; y < std::min(j + pass.step, y1); y++) {
+        for (int x = i; x < std::min(i + pass.step, x1); x++)
+            pixels[static_cast<size_t>(y - pass.y0) * width + x] = color;
+    }
+}
+
+void Renderer::fillAOVs(int i, int j, const RenderPass &pass, int x1, int y1, float coverage, float depth, int id) const {
+    if (!aovsEnabled)
+        return;
+
+    for (int y = j; y < std::min(j + pass.step, y1); y++) {
+        for (int x = i; x < std::min(i + pass.step, x1); x++) {
+            size_t k = static_cast<size_t>(y - pass.y0) * width + x;
+            aovBuffers.coverage[k] = coverage;
+            aovBuffers.depth[k] = depth;
+            aovBuffers.objectId[k] = id;
+        }
+    }
+}
+
+void Renderer::recordCost(int i, int j, int step, int x1, int y1, float work) const {
+    for (int y = j; y < std::min(j + step, y1); y++) {
+        for (int x = i; x < std::min(i + step, x1); x++)
+            costs[static_cast<size_t>(y) * width + x] = work;
+    }
+}
+
+int Renderer::renderTile(int x0, int y0, int x1, int y1, const RenderPass &pass, std::vector<glm::vec4> &pixels) const {
+    int numRays = 0;
+
+    for (int j = y0; j < y1; j += pass.step) {
+        for (int i = x0; i < x1; i += pass.step) {
+            if (tracedBefore(i, j, pass))
+                continue;
+
+            long long work = currentWork();
+
+            // the hit found here is shaded and tells the background apart
+            glm::vec3 d = primaryRay(i, j);
+            glm::vec3 color;
+            int id;
+            float depth;
+            tracePrimary(&d, 1, &color, &id, &depth);
+
+            fillBlock(i, j, pass, x1, y1, glm::vec4(color, 1.0f), pixels);
+            fillAOVs(i, j, pass, x1, y1, id >= 0 ? 1.0f : 0.0f, depth, id);
+            numRays++;
+
+            if (STATS_ENABLED)
+                recordCost(i, j, pass.step, x1, y1, static_cast<float>(currentWork() - work));
+        } // each col
+    } // each row
+
+    return numRays;
+}
+
+int Renderer::renderTilePackets(int x0, int y0, int x1, int y1, const RenderPass &pass, std::vector<glm::vec4> &pixels) const {
+    const int step = pass.step;
+    int numRays = 0;
+
+    for (int j = y0; j < y1; j += PACKET_ROWS * step) {
+        for (int i = x0; i < x1; i += PACKET_COLS * step) {
+            int activeBits = 0;
+            glm::vec3 d[PACKET_WIDTH];
+
+            // lanes that fall off the tile repeat the first ray and stay
+            // inactive, as do the pixels of earlier passes
+            for (int k = 0; k < PACKET_WIDTH; k++) {
+                int pi = i + (k % PACKET_COLS) * step;
+                int pj = j + (k / PACKET_COLS) * step;
+
+                if (pi < x1 && pj < y1) {
+                    if (!tracedBefore(pi, pj, pass))
+                        activeBits |= 1 << k;
+                    d[k] = primaryRay(pi, pj);
+                } else {
+                    d[k] = d[0];
+                }
+            }
+
+            if (activeBits == 0)
+                continue;
+
+            long long work = currentWork();
+
+            glm::vec3 colors[PACKET_WIDTH];
+            int ids[PACKET_WIDTH];
+            float depths[PACKET_WIDTH];
+            tracePacket(d, activeBits, colors, ids, depths);
+
+            float laneWork = 0.0f;
+            if (STATS_ENABLED) {
+                int numActive = 0;
+                for (int k = 0; k < PACKET_WIDTH; k++)
+                    numActive += (activeBits >> k) & 1;
+
+                laneWork = static_cast<float>(currentWork() - work) / numActive;
+            }
+
+            for (int k = 0; k < PACKET_WIDTH; k++) {
+                if (!((activeBits >> k) & 1))
+                    continue;
+
+                int pi = i + (k % PACKET_COLS) * step;
+                int pj = j + (k / PACKET_COLS) * step;
+
+                fillBlock(pi, pj, pass, x1, y1, glm::vec4(colors[k], 1.0f), pixels);
+                fillAOVs(pi, pj, pass, x1, y1, ids[k] >= 0 ? 1.0f : 0.0f, depths[k], ids[k]);
+                numRays++;
+
+                if (STATS_ENABLED)
+                    recordCost(pi, pj, step, x1, y1, laneWork);
+            }
+        } // each packet column
+    } // each packet row
+
+    return numRays;
+}
+
+// the rays of a wavefront tile and what they return, kept per thread as the
+// queues below so that every tile after the first reuses their memory
+struct TileRays {
+    std::vector<glm::vec3> d;
+    std::vector<int> coords;        // pixel x and y of each ray
+    std::vector<glm::vec3> colors;
+    std::vector<int> ids;
+    std::vector<float> depths;
+};
+
+static thread_local TileRays tileRays;
+
+int Renderer::renderTileWavefront(int x0, int y0, int x1, int y1, const RenderPass &pass, std::vector<glm::vec4> &pixels) const {
+    std::vector<glm::vec3> &d = tileRays.d;
+    std::vector<int> &coords = tileRays.coords;
+    d.clear();
+    coords.clear();
+
+    for (int j = y0; j < y1; j += pass.step) {
+        for (int i = x0; i < x1; i += pass.step) {
+            if (tracedBefore(i, j, pass))
+                continue;
+
+            d.push_back(primaryRay(i, j));
+            coords.push_back(i);
+            coords.push_back(j);
+        }
+    }
+
+    int numRays = static_cast<int>(d.size());
+    std::vector<glm::vec3> &colors = tileRays.colors;
+    std::vector<int> &ids = tileRays.ids;
+    std::vector<float> &depths = tileRays.depths;
+    colors.resize(numRays);
+    ids.resize(numRays);
+    depths.resize(numRays);
+
+    long long work = currentWork();
+    traceWavefront(d.data(), numRays, colors.data(), ids.data(), depths.data());
+
+    for (int k = 0; k < numRays; k++) {
+        fillBlock(coords[2 * k], coords[2 * k + 1], pass, x1, y1, glm::vec4(colors[k], 1.0f), pixels);
+        fillAOVs(coords[2 * k], coords[2 * k + 1], pass, x1, y1, ids[k] >= 0 ? 1.0f : 0.0f, depths[k], ids[k]);
+    }
+
+    // the waves mix the rays of the whole tile
+    if (STATS_ENABLED && numRays > 0) {
+        float rayWork = static_cast<float>(currentWork() - work) / numRays;
+
+        for (int k = 0; k < numRays; k++)
+            recordCost(coords[2 * k], coords[2 * k + 1], pass.step, x1, y1, rayWork);
+    }
+
+    return numRays;
+}
+
+// hash of a few integers to a float in [0, 1). Samples only depend on the
+// pixel and the sample number, never on the thread or tile order
+static float randomUnit(unsigned a, unsigned b, unsigned c) {
+    auto mix = [](unsigned x) {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    };
+
+    return (mix(mix(mix(a) ^ b) ^ c) >> 8) * (1.0f / 16777216.0f);
+}
+
+// the samples of a pixel differ enough to be worth refining
+static bool needsRefinement(const glm::vec3 *colors, const int *ids, int n) {
+    glm::vec3 lo = glm::clamp(colors[0], 0.0f, 1.0f);
+    glm::vec3 hi = lo;
+
+    for (int k = 1; k < n; k++) {
+        if (ids[k] != ids[0])
+            return true;
+
+        glm::vec3 c = glm::clamp(colors[k], 0.0f, 1.0f);
+        lo = glm::min(lo, c);
+        hi = glm::max(hi, c);
+    }
+
+    glm::vec3 contrast = hi - lo;
+    return std::max(contrast.x, std::max(contrast.y, contrast.z)) > AA_THRESHOLD;
+}
+
+int Renderer::renderTileAntialiased(int x0, int y0, int x1, int y1, const RenderPass &pass, std::vector<glm::vec4> &pixels) const {
+    const int n = aaSamples;
+    const int half = (n + 1) / 2;
+    int numRays = 0;
+
+    glm::vec3 d[AA_MAX_SAMPLES * AA_MAX_SAMPLES];
+    glm::vec3 colors[AA_MAX_SAMPLES * AA_MAX_SAMPLES];
+    int ids[AA_MAX_SAMPLES * AA_MAX_SAMPLES];
+    float depths[AA_MAX_SAMPLES * AA_MAX_SAMPLES];
+
+    for (int j = y0; j < y1; j += pass.step) {
+        for (int i = x0; i < x1; i += pass.step) {
+            if (tracedBefore(i, j, pass))
+                continue;
+
+            unsigned pixel = static_cast<unsigned>(j * width + i);
+            long long work = currentWork();
+
+            // jittered sample in cell (cx, cy) of the n x n grid over the pixel
+            auto sample = [&](int cx, int cy) {
+                unsigned cell = static_cast<unsigned>(cy * n + cx);
+                float x = i + (cx + randomUnit(pixel, cell, 0)) / n;
+                float y = j + (cy + randomUnit(pixel, cell, 1)) / n;
+                return primaryRay(x, y);
+            };
+
+            // one cell in each quadrant of the grid
+            int cells[4];
+            for (int q = 0; q < 4; q++) {
+                int qx0 = (q & 1) * half, qx1 = (q & 1) ? n : half;
+                int qy0 = (q >> 1) * half, qy1 = (q >> 1) ? n : half;
+
+                int cx = qx0 + std::min(static_cast<int>(randomUnit(pixel, q, 2) * (qx1 - qx0)), qx1 - qx0 - 1);
+                int cy = qy0 + std::min(static_cast<int>(randomUnit(pixel, q, 3) * (qy1 - qy0)), qy1 - qy0 - 1);
+
+                cells[q] = cy * n + cx;
+                d[q] = sample(cx, cy);
+            }
+
+            int numSamples = 4;
+            tracePrimary(d, numSamples, colors, ids, depths);
+
+            // then every other cell, each cell gets at most one sample
+            if (needsRefinement(colors, ids, numSamples)) {
+                for (int cell = 0; cell < n * n; cell++) {
+                    if (cell != cells[0] && cell != cells[1] && cell != cells[2] && cell != cells[3])
+                        d[numSamples++] = sample(cell % n, cell / n);
+                }
+
+                tracePrimary(d + 4, numSamples - 4, colors + 4, ids + 4, depths + 4);
+            }
+
+            glm::vec3 sum(0.0f);
+            for (int k = 0; k < numSamples; k++)
+                sum += colors[k];
+
+            fillBlock(i, j, pass, x1, y1, glm::vec4(sum / static_cast<float>(numSamples), 1.0f), pixels);
+
+            // the share of samples that hit, and the nearest of those hits
+            if (aovsEnabled) {
+                int numHits = 0, nearest = -1;
+                for (int k = 0; k < numSamples; k++) {
+                    if (ids[k] < 0)
+                        continue;
+
+                    numHits++;
+                    if (nearest < 0 || depths[k] < depths[nearest])
+                        nearest = k;
+                }
+
+                fillAOVs(i, j, pass, x1, y1,
+                         static_cast<float>(numHits) / numSamples,
+                         nearest >= 0 ? depths[nearest] : 0.0f,
+                         nearest >= 0 ? ids[nearest] : -1);
+            }
+            numRays += numSamples;
+
+            if (STATS_ENABLED)
+                recordCost(i, j, pass.step, x1, y1, static_cast<float>(currentWork() - work));
+        } // each col
+    } // each row
+
+    return numRays;
+}
+
+glm::vec3 Renderer::primaryRay(int i, int j) const {
+    return primaryRay(static_cast<float>(i), static_cast<float>(j));
+}
+
+glm::vec3 Renderer::primaryRay(float x, float y) const {
+    glm::vec4 p_clip = {
+        2.0f * x/(float)width - 1.0f,
+        1.0f - 2.0f * y/(float)height,
+        -1.0f,
+        1.0f
+    };
+
+    glm::vec4 p_eye = invProj * p_clip;
+    p_eye = glm::vec4(p_eye.x, p_eye.y, -1.0f, 0.0f);
+
+    return glm::normalize(glm::vec3(invView * p_eye));
+}
+
+void Renderer::tracePrimary(const glm::vec3 *d, int n, glm::vec3 *colors, int *ids, float *depths) const {
+    if (wavefrontTracing) {
+        traceWavefront(d, n, colors, ids, depths);
+        return;
+    }
+
+    if (packetTracing) {
+        for (int first = 0; first < n; first += PACKET_WIDTH) {
+            int count = std::min(PACKET_WIDTH, n - first);
+            glm::vec3 lanes[PACKET_WIDTH];
+            glm::vec3 laneColors[PACKET_WIDTH];
+            int laneIds[PACKET_WIDTH];
+            float laneDepths[PACKET_WIDTH];
+
+            for (int k = 0; k < PACKET_WIDTH; k++)
+                lanes[k] = d[first + std::min(k, count - 1)];
+
+            tracePacket(lanes, (1 << count) - 1, laneColors, laneIds, laneDepths);
+
+            for (int k = 0; k < count; k++) {
+                colors[first + k] = laneColors[k];
+                ids[first + k] = laneIds[k];
+                depths[first + k] = laneDepths[k];
+            }
+        }
+        return;
+    }
+
+    for (int k = 0; k < n; k++) {
+        HitRecord rec;
+
+        if (findNearestIntersection(eye, d[k], focalLength, FLOAT_INF, rec)) {
+            colors[k] = shade(eye, d[k], rec, 1);
+            ids[k] = rec.idx;
+            depths[k] = rec.t;
+        } else {
+            colors[k] = glm::vec3(0.0f);
+            ids[k] = -1;
+            depths[k] = 0.0f;
+        }
+    }
+}
+
+static RayPacket makePacket(const glm::vec3 &e, const glm::vec3 *d, int activeBits) {
+    float dx[PACKET_WIDTH], dy[PACKET_WIDTH], dz[PACKET_WIDTH];
+
+    for (int k = 0; k < PACKET_WIDTH; k++) {
+        dx[k] = d[k].x;
+        dy[k] = d[k].y;
+        dz[k] = d[k].z;
+    }
+
+    RayPacket rays;
+    rays.e = e;
+    rays.dx = PacketFloat::load(dx);
+    rays.dy = PacketFloat::load(dy);
+    rays.dz = PacketFloat::load(dz);
+    rays.invDx = 1.0f / rays.dx;
+    rays.invDy = 1.0f / rays.dy;
+    rays.invDz = 1.0f / rays.dz;
+    rays.active = PacketHit::laneMask(activeBits);
+
+    return rays;
+}
+
+void Renderer::tracePacket(const glm::vec3 *d, int activeBits, glm::vec3 *colors, int *ids, float *depths) const {
+    RayPacket rays = makePacket(eye, d, activeBits);
+
+    PacketHit hits;
+    hits.t = FLOAT_INF;
+    findNearestIntersection(rays, focalLength, hits);
+
+    for (int k = 0; k < PACKET_WIDTH; k++) {
+        ids[k] = hits.idx[k];
+
+        if (!((activeBits >> k) & 1) || hits.idx[k] < 0) {
+            colors[k] = glm::vec3(0.0f);
+            depths[k] = 0.0f;
+            continue;
+        }
+
+        depths[k] = hits.t[k];
+
+        HitRecord rec;
+        recordHit(hits, k, d[k], rec);
+
+        colors[k] = shade(eye, d[k], rec, 1);
+    }
+}
+
+void Renderer::recordHit(const PacketHit &hits, int k, const glm::vec3 &d, HitRecord &rec) const {
+    rec.idx = hits.idx[k];
+    rec.prim = hits.prim[k];
+    rec.t = hits.t[k];
+    rec.n = scene.normal(rec.idx, rec.prim, eye + rec.t * d);
+    rec.error = hitError(eye, d, rec.t);
+    rec.material = scene.materialIndex(rec.idx);
+}
+
+bool Renderer::findNearestIntersection(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, HitRecord &rec) const {
+
+    int nearest = -1;
+    float min_t = t1;
+
+    // ties are resolved towards the lower object index, so the result does
+    // not depend on the order in which the BVH hands out objects
+    auto test = [&](int i, float &tMax) {
+        float this_t;
+        int this_prim;
+        bool this_bool = scene.intersect(i, e, d, t0, this_t, this_prim);
+
+        if (this_bool && (this_t < min_t || (this_t == min_t && nearest > i))) {
+            min_t = this_t;
+            nearest = i;
+            tMax = this_t;
+
+            rec.idx = i;
+            rec.prim = this_prim;
+            rec.t = this_t;
+        }
+
+        return false;
+    };
+
+    for (int k = 0; k < static_cast<int>(scene.unbounded.size()); k++)
+        test(scene.unbounded[k], min_t);
+
+    scene.bvh.traverse(e, d, t0, min_t, test);
+
+    if (nearest < 0)
+        return false;
+
+    // only the nearest hit needs a normal
+    rec.n = scene.normal(rec.idx, rec.prim, e + rec.t * d);
+    rec.error = hitError(e, d, rec.t);
+    rec.material = scene.materialIndex(rec.idx);
+    return true;
+}
+
+void Renderer::findNearestIntersection(const RayPacket &rays, float t0, PacketHit &hits) const {
+    for (int k = 0; k < PACKET_WIDTH; k++) {
+        hits.idx[k] = -1;
+        hits.prim[k] = -1;
+    }
+
+    for (int k = 0; k < static_cast<int>(scene.unbounded.size()); k++)
+        scene.intersect(scene.unbounded[k], rays, t0, hits);
+
+    auto test = [&](int i) {
+        scene.intersect(i, rays, t0, hits);
+    };
+
+    scene.bvh.traversePacket(rays, t0, hits.t, test);
+}
+
+// the object (and triangle of a mesh) that last blocked each light, per
+// thread. Neighbouring shadow rays are mostly blocked by the same object
+struct Occluder {
+    int id;
+    int prim;
+};
+
+// only valid for the Renderer of that generation, the thread may have
+// rendered another scene before (a batch reuses the calling thread)
+struct OccluderCache {
+    unsigned long long generation;
+    std::vector<Occluder> lights;
+};
+
+static thread_local OccluderCache occluderCache = { 0, {} };
+
+bool Renderer::occluded(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, int light) const {
+    if (light >= 0) {
+        threadRays.shadow++;
+
+        if (occluderCache.generation != generation || occluderCache.lights.size() != scene.lights.size()) {
+            occluderCache.generation = generation;
+            occluderCache.lights.assign(scene.lights.size(), Occluder{ -1, -1 });
+        }
+
+        const Occluder &last = occluderCache.lights[light];
+        if (last.id >= 0 && scene.occludedBy(last.id, last.prim, e, d, t0, t1))
+            return true;
+    }
+
+    int occluder, occluderPrim;
+    bool hit = scene.occluded(e, d, t0, t1, occluder, occluderPrim);
+
+    // a ray that gets through forgets the occluder, lit regions then do not
+    // pay for testing it
+    if (light >= 0)
+        occluderCache.lights[light] = Occluder{ occluder, occluderPrim };
+
+    return hit;
+}
+
+glm::vec3 Renderer::raycolor(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, int recursionDepth) const {
+    HitRecord rec;
+
+    if (!findNearestIntersection(e, d, t0, t1, rec))
+        return glm::vec3(0.0f, 0.0f, 0.0f);
+
+    return shade(e, d, rec, recursionDepth);
+}
+
+// direction l and distance tMax from hit to light
+static void toLight(const ShadingLight &light, bool point, const glm::vec3 &hit, glm::vec3 &l, float &tMax) {
+    if (point) {
+        l = glm::normalize(light.v - hit);
+        tMax = glm::length(light.v - hit);
+    } else {
+        l = light.v;
+        tMax = FLOAT_INF;
+    }
+}
+
+// diffuse and specular part of an unblocked light, v points to the eye
+static glm::vec3 directLight(const glm::vec3 &diffuse, const glm::vec3 &specular, const HitRecord &rec, const Material &material, const glm::vec3 &v, const glm::vec3 &l) {
+    glm::vec3 h = glm::normalize(v + l);
+
+    float diff = std::max(0.0f, glm::dot(rec.n, l));
+    glm::vec3 diffuseColor = diffuse * (diff * material.kd);
+
+    float spec = pow(std::max(0.0f, glm::dot(rec.n, h)), material.shiness);
+    glm::vec3 specularColor = specular * (spec * material.ks);
+
+    return diffuseColor + specularColor;
+}
+
+static float maxComponent(const glm::vec3 &c) {
+    return std::max(c.x, std::max(c.y, c.z));
+}
+
+glm::vec3 Renderer::lightContribution(const ShadingLight &light, bool point, const glm::vec3 &hit, const glm::vec3 &v, const HitRecord &rec) const {
+    glm::vec3 l;
+    float tMax;
+    toLight(light, point, hit, l, tMax);
+
+    // the light shines on the back of the surface. directLight would still
+    // give it a Blinn highlight just past the terminator; that is dropped
+    if (glm::dot(rec.n, l) <= 0.0f)
+        return glm::vec3(0.0f);
+
+    // shaded before the shadow ray is traced, so dim lights can skip it
+    glm::vec3 color = directLight(light.diffuse, light.specular, rec, scene.materials[rec.material], v, l);
+    if (maxComponent(color) <= lightCutoff)
+        return glm::vec3(0.0f);
+
+    if (occluded(offsetRayOrigin(hit, rec.n, rec.error, l), l, 0.0f, tMax, light.index))
+        return glm::vec3(0.0f);
+
+    return color;
+}
+
+// the largest cosine between n and the direction from hit to any point of
+// box, 0 if the whole box is behind the plane through hit
+static float maxCosine(const AABB &box, const glm::vec3 &hit, const glm::vec3 &n) {
+    // the corner furthest along n
+    glm::vec3 corner(n.x > 0.0f ? box.max.x : box.min.x,
+                     n.y > 0.0f ? box.max.y : box.min.y,
+                     n.z > 0.0f ? box.max.z : box.min.z);
+
+    float height = glm::dot(n, corner - hit);
+    if (height <= 0.0f)
+        return 0.0f;
+
+    glm::vec3 nearest = glm::max(box.min, glm::min(hit, box.max));
+    float distance = glm::length(nearest - hit);
+
+    return distance > height ? height / distance : 1.0f;
+}
+
+// cos(max(0, a - b)) and cos(min(pi, a + b)) from the cosines of a and b,
+// both angles in [0, pi]
+static float cosDifference(float cosA, float cosB) {
+    if (cosA >= cosB)
+        return 1.0f;
+
+    return cosA * cosB + std::sqrt(std::max(0.0f, (1.0f - cosA * cosA) * (1.0f - cosB * cosB)));
+}
+
+static float cosSum(float cosA, float cosB) {
+    float c = cosA * cosB - std::sqrt(std::max(0.0f, (1.0f - cosA * cosA) * (1.0f - cosB * cosB)));
+    // a + b past pi
+    return cosA < -cosB ? -1.0f : c;
+}
+
+// what the lights of a cluster can add at most at hit: each of them at the
+// best angle to n and with the strongest highlight any direction into the
+// box could give. Directions into the box lie in the cone around the
+// direction to its center that holds its bounding sphere
+static glm::vec3 clusterBound(const LightNode &node, const glm::vec3 &hit, const glm::vec3 &v, const HitRecord &rec, const Material &material) {
+    float nl = maxCosine(node.box, hit, rec.n);
+    if (nl <= 0.0f)
+        return glm::vec3(0.0f);
+
+    glm::vec3 toCenter = node.box.centroid() - hit;
+    float distance = glm::length(toCenter);
+    float radius = 0.5f * glm::length(node.box.max - node.box.min);
+
+    // the smallest cosine between v and a direction to the box
+    float vl = -1.0f;
+
+    if (distance > radius) {
+        glm::vec3 axis = toCenter / distance;
+        float cosCone = std::sqrt(1.0f - (radius / distance) * (radius / distance));
+
+        nl = std::min(nl, cosDifference(glm::dot(rec.n, axis), cosCone));
+        vl = cosSum(glm::dot(v, axis), cosCone);
+    }
+
+    // n.h = (n.v + n.l) / |v + l| and |v + l|^2 = 2 + 2 v.l
+    float nh = 1.0f;
+    if (vl > -1.0f)
+        nh = std::min(1.0f, (glm::dot(rec.n, v) + nl) / std::sqrt(2.0f + 2.0f * vl));
+
+    float spec = pow(std::max(0.0f, nh), material.shiness);
+
+    return node.diffuse * (nl * material.kd) + node.specular * (spec * material.ks);
+}
+
+// a cluster of the cut of the light tree, with what its representative
+// estimates for it and how far off that could be
+struct CutCluster {
+    int node;
+    float error;
+    glm::vec3 estimate;
+    bool visible;   // whether the representative reaches the hit
+
+    bool operator<(const CutCluster &other) const { return error < other.error; }
+};
+
+static thread_local std::vector<CutCluster> lightCutHeap;
+
+glm::vec3 Renderer::lightCut(const glm::vec3 &hit, const glm::vec3 &v, const glm::vec3 &base, const HitRecord &rec) const {
+    std::vector<CutCluster> &heap = lightCutHeap;
+    heap.clear();
+
+    const Material &material = scene.materials[rec.material];
+    glm::vec3 total(0.0f);
+    // shadow rays only go to lights in front of n, all from the same origin
+    glm::vec3 adjustedHit = offsetRayOrigin(hit, rec.n, rec.error, rec.n);
+
+    // adds the estimate of a cluster to the cut, skipping clusters that
+    // cannot add more than lightCutoff. A child with the representative of
+    // its parent takes the shadow ray of the parent
+    auto add = [&](int n, int parentRepresentative, bool parentVisible) {
+        const LightNode &node = lights.nodes[n];
+
+        glm::vec3 bound = clusterBound(node, hit, v, rec, material);
+        if (maxComponent(bound) <= lightCutoff)
+            return;
+
+        const ShadingLight &representative = lights.points[node.representative];
+
+        glm::vec3 l;
+        float tMax;
+        toLight(representative, true, hit, l, tMax);
+
+        CutCluster c;
+        c.node = n;
+        c.estimate = glm::vec3(0.0f);
+        c.visible = false;
+        // a single light is exact
+        c.error = node.left < 0 ? 0.0f : maxComponent(bound);
+
+        if (glm::dot(rec.n, l) > 0.0f) {
+            c.visible = node.representative == parentRepresentative
+                      ? parentVisible
+                      : !occluded(adjustedHit, l, 0.0f, tMax, representative.index);
+
+            if (c.visible)
+                c.estimate = directLight(node.diffuse, node.specular, rec, material, v, l);
+        }
+
+        total += c.estimate;
+        heap.push_back(c);
+        std::push_heap(heap.begin(), heap.end());
+    };
+
+    add(0, -1, false);
+
+    while (!heap.empty() && static_cast<int>(heap.size()) < LIGHT_CUT_MAX) {
+        CutCluster worst = heap.front();
+        if (worst.error <= lightError * maxComponent(base + total))
+            break;
+
+        std::pop_heap(heap.begin(), heap.end());
+        heap.pop_back();
+        total -= worst.estimate;
+
+        const LightNode &node = lights.nodes[worst.node];
+        add(node.left, node.representative, worst.visible);
+        add(node.right, node.representative, worst.visible);
+    }
+
+    return total;
+}
+
+glm::vec3 Renderer::directLighting(const glm::vec3 &e, const glm::vec3 &hit, const HitRecord &rec) const {
+    glm::vec3 color = scene.materials[rec.material].ka * lights.ambient;
+    glm::vec3 v = glm::normalize(e - hit);
+
+    for (const ShadingLight &light : lights.directionals)
+        color += lightContribution(light, false, hit, v, rec);
+
+    if (useLightTree())
+        return color + lightCut(hit, v, color, rec);
+
+    for (const ShadingLight &light : lights.points)
+        color += lightContribution(light, true, hit, v, rec);
+
+    return color;
+}
+
+glm::vec3 Renderer::shade(const glm::vec3 &e, const glm::vec3 &d, const HitRecord &rec, int recursionDepth) const {
+    glm::vec3 hit = e + rec.t * d;
+
+    glm::vec3 color = directLighting(e, hit, rec);
+
+    if (recursionDepth < MAXRECURSION) {
+        threadRays.reflection++;
+
+        glm::vec3 r = glm::reflect(d, rec.n);
+        color += scene.materials[rec.material].km * raycolor(offsetRayOrigin(hit, rec.n, rec.error, r), r, 0.0f, FLOAT_INF, recursionDepth + 1);
+    }
+
+    return color;
+}
+
+// a ray of a wave and the sample it contributes to
+struct PathRay {
+    glm::vec3 e;
+    glm::vec3 d;
+    glm::vec3 throughput;   // product of the km along the path so far
+    float t0;
+    int sample;
+    int depth;              // 1 for primary rays, as in raycolor
+};
+
+// the queues of traceWavefront, kept per thread so that the waves of the
+// next tile reuse their memory
+struct WavefrontQueues {
+    std::vector<PathRay> rays;
+    std::vector<PathRay> nextRays;
+    std::vector<HitRecord> hits;
+    std::vector<int> hitRays;           // ray of each hit
+    std::vector<glm::vec3> lit;         // per hit and light, what reaches the hit
+    // per sample and depth: the color of the hit without reflections and
+    // its km, combined once every wave is done
+    std::vector<glm::vec3> direct;
+    std::vector<glm::vec3> km;
+};
+
+static thread_local WavefrontQueues wavefrontQueues;
+
+void Renderer::traceWavefront(const glm::vec3 *d, int n, glm::vec3 *colors, int *ids, float *depths) const {
+    WavefrontQueues &q = wavefrontQueues;
+
+    // the light tree is cut hit by hit, in the shading loop below
+    const int numDirectionals = static_cast<int>(lights.directionals.size());
+    const int numLights = numDirectionals + (useLightTree() ? 0 : static_cast<int>(lights.points.size()));
+
+    q.direct.assign(static_cast<size_t>(n) * MAXRECURSION, glm::vec3(0.0f));
+    q.km.assign(static_cast<size_t>(n) * MAXRECURSION, glm::vec3(0.0f));
+    q.rays.clear();
+
+    for (int k = 0; k < n; k++) {
+        q.rays.push_back(PathRay{ eye, d[k], glm::vec3(1.0f), focalLength, k, 1 });
+        ids[k] = -1;
+        depths[k] = 0.0f;
+    }
+
+    while (!q.rays.empty()) {
+        q.hits.clear();
+        q.hitRays.clear();
+
+        // nearest hits, in packets for the primary rays since they share
+        // the eye
+        if (packetTracing && q.rays[0].depth == 1) {
+            for (int first = 0; first < static_cast<int>(q.rays.size()); first += PACKET_WIDTH) {
+                int count = std::min(PACKET_WIDTH, static_cast<int>(q.rays.size()) - first);
+                glm::vec3 lanes[PACKET_WIDTH];
+
+                for (int k = 0; k < PACKET_WIDTH; k++)
+                    lanes[k] = q.rays[first + std::min(k, count - 1)].d;
+
+                RayPacket rays = makePacket(eye, lanes, (1 << count) - 1);
+                PacketHit hits;
+                hits.t = FLOAT_INF;
+                findNearestIntersection(rays, focalLength, hits);
+
+                for (int k = 0; k < count; k++) {
+                    if (hits.idx[k] < 0)
+                        continue;
+
+                    q.hits.emplace_back();
+                    recordHit(hits, k, lanes[k], q.hits.back());
+                    q.hitRays.push_back(first + k);
+                }
+            }
+        } else {
+            for (int r = 0; r < static_cast<int>(q.rays.size()); r++) {
+                const PathRay &ray = q.rays[r];
+                HitRecord rec;
+
+                if (findNearestIntersection(ray.e, ray.d, ray.t0, FLOAT_INF, rec)) {
+                    q.hits.push_back(rec);
+                    q.hitRays.push_back(r);
+                }
+            }
+        }
+
+        const int numHits = static_cast<int>(q.hits.size());
+
+        // shadow rays, light by light so that the occluder cache of a light
+        // sees neighbouring rays one after the other. Lights in the order
+        // of directLighting
+        q.lit.resize(static_cast<size_t>(numHits) * numLights);
+
+        for (int j = 0; j < numLights; j++) {
+            bool point = j >= numDirectionals;
+            const ShadingLight &light = point ? lights.points[j - numDirectionals] : lights.directionals[j];
+
+            for (int h = 0; h < numHits; h++) {
+                const PathRay &ray = q.rays[q.hitRays[h]];
+                const HitRecord &rec = q.hits[h];
+
+                glm::vec3 hit = ray.e + rec.t * ray.d;
+                q.lit[h * numLights + j] = lightContribution(light, point, hit, glm::normalize(ray.e - hit), rec);
+            }
+        }
+
+        // shading in the order of shade, and the reflection rays of the next
+        // wave
+        q.nextRays.clear();
+
+        for (int h = 0; h < numHits; h++) {
+            const PathRay &ray = q.rays[q.hitRays[h]];
+            const HitRecord &rec = q.hits[h];
+
+            const Material &material = scene.materials[rec.material];
+
+            glm::vec3 hit = ray.e + rec.t * ray.d;
+            glm::vec3 color = material.ka * lights.ambient;
+
+            for (int j = 0; j < numLights; j++)
+                color += q.lit[h * numLights + j];
+
+            if (useLightTree())
+                color += lightCut(hit, glm::normalize(ray.e - hit), color, rec);
+
+            size_t level = static_cast<size_t>(ray.sample) * MAXRECURSION + ray.depth - 1;
+            q.direct[level] = color;
+            q.km[level] = material.km;
+
+            if (ray.depth == 1) {
+                ids[ray.sample] = rec.idx;
+                depths[ray.sample] = rec.t;
+            }
+
+            if (ray.depth < MAXRECURSION) {
+                glm::vec3 throughput = ray.throughput * material.km;
+
+                if (std::max(throughput.x, std::max(throughput.y, throughput.z)) > minThroughput) {
+                    threadRays.reflection++;
+
+                    glm::vec3 r = glm::reflect(ray.d, rec.n);
+                    q.nextRays.push_back(PathRay{ offsetRayOrigin(hit, rec.n, rec.error, r), r, throughput, 0.0f, ray.sample, ray.depth + 1 });
+                }
+            }
+        }
+
+        q.rays.swap(q.nextRays);
+    }
+
+    // color = direct + km * (color of the reflection), from the deepest
+    // bounce up as raycolor returns. A bounce that missed or was dropped
+    // adds km * 0, like a reflection ray of raycolor that hits nothing
+    for (int k = 0; k < n; k++) {
+        glm::vec3 color(0.0f);
+
+        for (int depth = MAXRECURSION; depth >= 1; depth--) {
+            size_t level = static_cast<size_t>(k) * MAXRECURSION + depth - 1;
+            color = q.direct[level] + q.km[level] * color;
+        }
+
+        colors[k] = color;
+    }
+}
+
+void Renderer::releaseThreadCaches() {
+    occluderCache = OccluderCache{ 0, {} };
+    tileRays = TileRays();
+    lightCutHeap = std::vector<CutCluster>();
+    wavefrontQueues = WavefrontQueues();
+}
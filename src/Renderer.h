@@ -0,0 +1,204 @@
+#pragma once
+
+#include <vector>
+#include <functional>
+
+#include "Scene.h"
+#include "Packet.h"
+#include "LightSet.h"
+#include "WorkerPool.h"
+
+#include <glm/glm.hpp>
+
+struct HitRecord {
+    int idx;
+    int prim;   // triangle of a mesh, -1 for other objects
+    float t;
+    MaterialIndex material;     // shading reads the fields it needs from Scene::materials
+
+    glm::vec3 n;
+    glm::vec3 error;    // bound on the rounding error of each coordinate of the hit point
+};
+
+// origin of a ray that leaves hit in direction w: hit moved along n, to
+// the side w goes to, just past its rounding error (HitRecord::error), as
+// in pbrt. The error grows with the coordinates, so the offset does too,
+// unlike a fixed epsilon that is lost in the rounding of large coordinates
+// and needlessly far off the surface of small objects
+glm::vec3 offsetRayOrigin(const glm::vec3 &hit, const glm::vec3 &n, const glm::vec3 &error, const glm::vec3 &w);
+
+// one pass of a progressive render: traces every pixel whose coordinates
+// are multiples of step, except those the previous pass (at skip) already
+// traced, and fills the step x step block below and right of each pixel.
+// Only rows [y0, y1) are rendered, the pixels given hold row y0 first
+struct RenderPass {
+    int step;
+    int skip;   // 0 for the first pass
+    int y0, y1;
+};
+
+// what the primary rays found per pixel besides the color, in the same
+// layout as the pixels. Filled from the rays that are shaded anyway
+struct AOVBuffers {
+    std::vector<float> coverage;    // share of the samples of the pixel that hit an object
+    std::vector<float> depth;       // distance from the eye to the nearest of those hits, 0 if none
+    std::vector<int> objectId;      // object of that hit, -1 if none
+};
+
+// how far a cut of the light tree may be off by default, relative to all
+// the light at the hit (as in Lightcuts)
+static const float DEFAULT_LIGHT_ERROR = 0.02f;
+
+// rays traced by the render calls of a renderer, by kind
+struct RayCounts {
+    long long primary;
+    long long shadow;
+    long long reflection;
+};
+
+class Renderer {
+private:
+    const Scene &scene;
+
+    int width;
+    int height;
+
+    float focalLength;
+    glm::vec3 eye;
+    glm::mat4 invView;
+    glm::mat4 invProj;
+
+    bool packetTracing;
+    bool wavefrontTracing;
+    float minThroughput;
+    int aaSamples;
+
+    LightSet lights;
+    float lightCutoff;
+    float lightError;
+    // new for every Renderer, per-thread caches made for another one are
+    // dropped at their first use in this one
+    unsigned long long generation;
+
+    bool aovsEnabled;
+    mutable AOVBuffers aovBuffers;  // rows of the last band or image
+
+    mutable RayCounts counts;   // updated once a pass is done
+    mutable std::vector<float> costs;   // only kept with SRT_INSTRUMENT
+
+    // fills rec for lane k of a packet hit (hits.idx[k] >= 0)
+    void recordHit(const PacketHit &hits, int k, const glm::vec3 &d, HitRecord &rec) const;
+    long long renderPass(const RenderPass &pass, std::vector<glm::vec4> &pixels, WorkerPool &workers) const;
+    void fillBlock(int i, int j, const RenderPass &pass, int x1, int y1, const glm::vec4 &color, std::vector<glm::vec4> &pixels) const;
+    void recordCost(int i, int j, int step, int x1, int y1, float work) const;
+    void resetAOVs(size_t numPixels) const;
+    void fillAOVs(int i, int j, const RenderPass &pass, int x1, int y1, float coverage, float depth, int id) const;
+    // point lights are cut from the light tree instead of shaded one by one
+    bool useLightTree() const;
+    // what light adds at hit (v points to the eye): zero without a shadow
+    // ray when it is behind the surface or adds at most lightCutoff
+    glm::vec3 lightContribution(const ShadingLight &light, bool point, const glm::vec3 &hit, const glm::vec3 &v, const HitRecord &rec) const;
+    // the point lights at hit through a cut of the light tree, its error is
+    // relative to base (the light from everything else) plus the cut
+    glm::vec3 lightCut(const glm::vec3 &hit, const glm::vec3 &v, const glm::vec3 &base, const HitRecord &rec) const;
+
+public:
+    Renderer(Scene &s, int w, int h);
+
+    // trace primary rays in packets of PACKET_WIDTH, on by default when the
+    // build has SIMD support. Secondary rays are always traced one by one
+    void setPacketTracing(bool enabled);
+    // samplesPerSide > 1 turns on adaptive anti-aliasing: every pixel gets
+    // four jittered samples (one per quadrant of a samplesPerSide^2 grid),
+    // and all the cells of the grid only where those four disagree
+    void setAntialiasing(int samplesPerSide);
+    // trace rays in waves instead of recursively: all primary rays of a
+    // tile, then all their shadow rays light by light, then all reflection
+    // rays, and so on for every bounce. Reflection rays whose throughput
+    // (the product of the km along the path) is at most minThroughput in
+    // every channel are dropped, with 0 the image is the same as without
+    void setWavefront(bool enabled, float minThroughput = 0.0f);
+    // lights that add at most cutoff (in every channel) to a hit get no
+    // shadow ray. From a few hundred point lights on, they are shaded
+    // by cutting the light tree instead (see LightSet): clusters are split
+    // until none of them could be off by more than maxError times the
+    // estimate of all of them, and each remaining cluster costs one shadow
+    // ray. maxError 0 shades every light on its own
+    void setLightCulling(float cutoff, float maxError);
+    // fill the AOV buffers while rendering, off by default
+    void setAOVs(bool enabled);
+
+    // renders the whole image into pixels (resized to width*height,
+    // row-major), returns the number of primary rays traced
+    long long render(std::vector<glm::vec4> &pixels, WorkerPool &workers) const;
+    // renders the same image in passes, every pixel is traced once: first
+    // one pixel in firstStep x firstStep (a power of two), then each pass
+    // halves the step. passDone(pass, numPasses) is called after each pass
+    // with pixels holding the image so far (untraced pixels repeat a
+    // traced neighbour)
+    long long renderProgressive(std::vector<glm::vec4> &pixels,
+                                WorkerPool &workers,
+                                int firstStep,
+                                const std::function<void(int, int)> &passDone) const;
+    // renders the image top to bottom in bands of bandRows rows (rounded up
+    // to whole tiles), calling bandDone(y0, y1, pixels) with rows [y0, y1)
+    // as soon as a band is done. Only one band is held in memory, the
+    // image is the same as from render()
+    long long renderBands(WorkerPool &workers,
+                          int bandRows,
+                          const std::function<void(int, int, const std::vector<glm::vec4>&)> &bandDone) const;
+
+    // totals over every render and renderProgressive call so far
+    RayCounts rayCounts() const;
+    // work (see Stats::work) spent on each pixel of the last render, empty
+    // unless built with SRT_INSTRUMENT. Packets share their cost among
+    // their rays, and with wavefront tracing the pixels of a tile share the
+    // cost of the tile
+    const std::vector<float> &pixelCosts() const;
+    // AOVs of the last render or renderProgressive call, or of the band
+    // just rendered when called from bandDone. Empty unless turned on
+    const AOVBuffers &aovs() const;
+
+    // empties the per-thread caches of the calling thread: the occluders of
+    // the last scene and the scratch buffers sized for its largest tile.
+    // The threads of a WorkerPool stay for the next scene of a batch, so
+    // run it on each of them between scenes
+    static void releaseThreadCaches();
+
+    // render the pixels of a pass covered by [x0, x1) x [y0, y1), x0 and
+    // y0 have to be multiples of pass.step. Return the primary rays traced
+    int renderTile(int x0, int y0, int x1, int y1, const RenderPass &pass, std::vector<glm::vec4> &pixels) const;
+    int renderTilePackets(int x0, int y0, int x1, int y1, const RenderPass &pass, std::vector<glm::vec4> &pixels) const;
+    int renderTileWavefront(int x0, int y0, int x1, int y1, const RenderPass &pass, std::vector<glm::vec4> &pixels) const;
+    int renderTileAntialiased(int x0, int y0, int x1, int y1, const RenderPass &pass, std::vector<glm::vec4> &pixels) const;
+
+    // direction of the primary ray through the corner of pixel (i, j)
+    glm::vec3 primaryRay(int i, int j) const;
+    // through the point (x, y) of the image plane, in pixels
+    glm::vec3 primaryRay(float x, float y) const;
+
+    // color, object id (-1 on a miss) and t of the hit (0 on a miss) of n
+    // primary rays, traced in packets when packet tracing is on. Each ray
+    // is traced once, the hit it finds is the one that is shaded
+    void tracePrimary(const glm::vec3 *d, int n, glm::vec3 *colors, int *ids, float *depths) const;
+    // the same for the active lanes of one packet
+    void tracePacket(const glm::vec3 *d, int activeBits, glm::vec3 *colors, int *ids, float *depths) const;
+    // the same as tracePrimary, one wave of rays at a time
+    void traceWavefront(const glm::vec3 *d, int n, glm::vec3 *colors, int *ids, float *depths) const;
+
+    // returns true if the ray hits any object with t in (t0, t1), stopping at
+    // the first hit found and never computing normals. For a shadow ray,
+    // light is the index of the light: the object that last blocked it on
+    // this thread is tested before anything else
+    bool occluded(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, int light = -1) const;
+    // compute the color of a pixel using Blinn-Phong Shading
+    glm::vec3 raycolor(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, int recursionDepth) const;
+    // Blinn-Phong shading (plus reflections) of a hit already found for the ray (e, d)
+    glm::vec3 shade(const glm::vec3 &e, const glm::vec3 &d, const HitRecord &rec, int recursionDepth) const;
+    // the ambient, diffuse and specular part of shade, without reflections
+    glm::vec3 directLighting(const glm::vec3 &e, const glm::vec3 &hit, const HitRecord &rec) const;
+    // find the nearest intersection and record necessary info to compute color
+    bool findNearestIntersection(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, HitRecord &rec) const;
+    // same for every active lane of a packet, hits.t must hold t1 on entry
+    void findNearestIntersection(const RayPacket &rays, float t0, PacketHit &hits) const;
+};
@@ -1,268 +1,591 @@
 #include "Scene.h"
 
-static std::string readFile(std::string filepath) {
-    std::ifstream t(filepath);
+#include <thread>
+#include <algorithm>
 
-    if (t.is_open()) {
-        std::string str((std::istreambuf_iterator<char>(t)),
-                         std::istreambuf_iterator<char>());
-        return str;
-    } 
+#include "SceneReader.h"
 
-    std::cerr << "Failed to open " << filepath << std::endl;
-    return "";
+#include <glm/gtc/quaternion.hpp>
+
+static void setCamera(const CameraParams &params, Camera3D &camera) {
+    float ratio = params.width/params.height;
+    float fov = 2.0f * std::atan2(0.5f * params.height, params.focalLength);
+
+    camera.update(params.focalLength, fov, ratio, params.eye, params.up, params.look);
 }
 
-std::string dirname(std::string filepath) {
-    #if defined(WIN32) || defined(_WIN32)
-        std::size_t slash = filepath.find("\\");
-        while (slash != std::string::npos) {
-            filepath.replace(slash, 1, "/");
-            slash = filepath.find("\\");
-        }
-    #endif
+template <typename T>
+static void sortKeys(std::vector<Keyframe<T>> &keys) {
+    std::stable_sort(keys.begin(), keys.end(), [](const Keyframe<T> &a, const Keyframe<T> &b) {
+        return a.frame < b.frame;
+    });
+}
 
-    std::size_t pos = filepath.find_last_of("/");
+// the key at or before frame (the first one before all of them), w is how
+// far frame is from it to the next key
+template <typename T>
+static int findKey(const std::vector<Keyframe<T>> &keys, float frame, float &w) {
+    int i = 0;
+    while (i + 1 < static_cast<int>(keys.size()) && keys[i + 1].frame <= frame)
+        i++;
 
-    if (pos == std::string::npos)
-        return "";
+    w = 0.0f;
+    if (i + 1 < static_cast<int>(keys.size()) && frame > keys[i].frame)
+        w = (frame - keys[i].frame) / (keys[i + 1].frame - keys[i].frame);
 
-    return filepath.substr(0, pos);
+    return i;
 }
 
-static bool jsonMemberCheck(const rapidjson::Value& val, 
-                            std::string memberName, 
-                            std::string memberType) {
-    
-    if (!val.HasMember(memberName.c_str())) 
-        return false;
+static CameraParams interpolate(const CameraParams &a, const CameraParams &b, float w) {
+    CameraParams params;
 
-    if (memberType == "object") {
-        return val[memberName.c_str()].IsObject();
-    } else if (memberType == "string") {
-        return val[memberName.c_str()].IsString();
-    } else if (memberType == "number") {
-        return val[memberName.c_str()].IsNumber();
-    } else if (memberType == "array") {
-        return val[memberName.c_str()].IsArray();
-    } else {
-        return false;
-    }
+    params.focalLength = glm::mix(a.focalLength, b.focalLength, w);
+    params.width = glm::mix(a.width, b.width, w);
+    params.height = glm::mix(a.height, b.height, w);
+    params.eye = glm::mix(a.eye, b.eye, w);
+    params.up = glm::mix(a.up, b.up, w);
+    params.look = glm::mix(a.look, b.look, w);
+
+    return params;
 }
 
-static glm::vec3 parseVec3(const rapidjson::Value& jsonVec) {
-    assert(jsonVec.IsArray());
-    assert(jsonVec.Capacity() == 3);
-    assert(jsonVec[0].IsNumber() && jsonVec[1].IsNumber() && jsonVec[2].IsNumber());
+// rotation and scale of a model matrix without shear, a mirroring matrix
+// gets a negative x scale
+static glm::quat rotation(const glm::mat4 &model, glm::vec3 &scale) {
+    glm::mat3 linear(model);
+
+    for (int c = 0; c < 3; c++)
+        scale[c] = glm::length(linear[c]);
+
+    if (glm::determinant(linear) < 0.0f)
+        scale.x = -scale.x;
+
+    for (int c = 0; c < 3; c++)
+        linear[c] = linear[c] / scale[c];
 
-    return glm::vec3(jsonVec[0].GetFloat(), jsonVec[1].GetFloat(), jsonVec[2].GetFloat());
+    return glm::quat_cast(linear);
 }
 
-static glm::mat4 parseMat4(const rapidjson::Value& jsonMat) {
-    assert(jsonMat.IsArray());
-    assert(jsonMat.Capacity() == 4);
-    assert(jsonMat[0].Capacity() == 4);
-    assert(jsonMat[1].Capacity() == 4);
-    assert(jsonMat[2].Capacity() == 4);
-    assert(jsonMat[3].Capacity() == 4);
+static glm::mat4 interpolate(const glm::mat4 &a, const glm::mat4 &b, float w) {
+    // keys that hold still give exactly their matrix, so nothing is refit
+    if (w == 0.0f || a == b)
+        return a;
+
+    glm::vec3 scaleA, scaleB;
+    glm::quat rotationA = rotation(a, scaleA);
+    glm::quat rotationB = rotation(b, scaleB);
+
+    glm::mat3 linear = glm::mat3_cast(glm::slerp(rotationA, rotationB, w));
+    glm::vec3 scale = glm::mix(scaleA, scaleB, w);
+
+    glm::mat4 model(1.0f);
+    for (int c = 0; c < 3; c++)
+        model[c] = glm::vec4(linear[c] * scale[c], 0.0f);
+    model[3] = glm::vec4(glm::mix(glm::vec3(a[3]), glm::vec3(b[3]), w), 1.0f);
 
-    return glm::mat4(
-        jsonMat[0][0].GetFloat(), jsonMat[1][0].GetFloat(), jsonMat[2][0].GetFloat(), jsonMat[3][0].GetFloat(),
-        jsonMat[0][1].GetFloat(), jsonMat[1][1].GetFloat(), jsonMat[2][1].GetFloat(), jsonMat[3][1].GetFloat(),
-        jsonMat[0][2].GetFloat(), jsonMat[1][2].GetFloat(), jsonMat[2][2].GetFloat(), jsonMat[3][2].GetFloat(),
-        jsonMat[0][3].GetFloat(), jsonMat[1][3].GetFloat(), jsonMat[2][3].GetFloat(), jsonMat[3][3].GetFloat()
-    );
+    return model;
 }
 
-static void parseCamera(const rapidjson::Value& jsonCamera, Camera3D &camera) {
-    assert(jsonCamera.IsObject());
+template <typename T>
+static T sampleKeys(const std::vector<Keyframe<T>> &keys, float frame) {
+    float w;
+    int i = findKey(keys, frame, w);
 
-    assert(jsonMemberCheck(jsonCamera, "type", "string"));
-    assert(jsonMemberCheck(jsonCamera, "focal_length", "number"));
-    assert(jsonMemberCheck(jsonCamera, "eye", "array"));
-    assert(jsonMemberCheck(jsonCamera, "up", "array"));
-    assert(jsonMemberCheck(jsonCamera, "look", "array"));
-    assert(jsonMemberCheck(jsonCamera, "height", "number"));
-    assert(jsonMemberCheck(jsonCamera, "width", "number"));
+    if (w == 0.0f)
+        return keys[i].value;
 
-    std::string cameraType = jsonCamera["type"].GetString();
-    assert(cameraType == "perspective" && "Only perspective cameras are supported");
+    return interpolate(keys[i].value, keys[i + 1].value, w);
+}
 
-    float width = jsonCamera["width"].GetFloat();
-    float height = jsonCamera["height"].GetFloat();
-    float focal_length = jsonCamera["focal_length"].GetFloat();
+Scene::Scene()
+        : lights{}
+        , objects{}
+        , useMeshCache{true}
+        , meshLibrary{nullptr}
+        , numLoadThreads{static_cast<int>(std::max(1u, std::thread::hardware_concurrency()))} {}
+
+int Scene::addPlane(const glm::vec3 &point, const glm::vec3 &normal, MaterialIndex material) {
+    ObjectRef ref = { ObjectType::Plane, material, planes.add(point, normal) };
+    objects.push_back(ref);
+    return static_cast<int>(objects.size()) - 1;
+}
 
-    float ratio = width/height;
-    float fov = 2.0f * std::atan2(0.5f * height, focal_length);
+int Scene::addSphere(const glm::vec3 &center, float radius, MaterialIndex material) {
+    ObjectRef ref = { ObjectType::Sphere, material, spheres.add(center, radius) };
+    objects.push_back(ref);
+    return static_cast<int>(objects.size()) - 1;
+}
+
+int Scene::addTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, MaterialIndex material) {
+    ObjectRef ref = { ObjectType::Triangle, material, triangles.add(a, b, c) };
+    objects.push_back(ref);
+    return static_cast<int>(objects.size()) - 1;
+}
 
-    glm::vec3 eye = parseVec3(jsonCamera["eye"]);
-    glm::vec3 up = parseVec3(jsonCamera["up"]);
-    glm::vec3 look = parseVec3(jsonCamera["look"]);
+int Scene::addMesh(TriangleMesh &&mesh, MaterialIndex material) {
+    return addMesh(std::make_shared<const TriangleMesh>(std::move(mesh)), material);
+}
 
-    camera.update(focal_length, fov, ratio, eye, up, look);
+int Scene::addMesh(std::shared_ptr<const TriangleMesh> mesh, MaterialIndex material) {
+    meshes.push_back(std::move(mesh));
+    return addInstance(static_cast<int>(meshes.size()) - 1, glm::mat4(1.0f), material);
 }
 
-static Material parseMaterial(const rapidjson::Value& jsonMaterial) {
-    assert(jsonMaterial.IsObject());
-    assert(jsonMemberCheck(jsonMaterial, "ka", "array"));
-    assert(jsonMemberCheck(jsonMaterial, "kd", "array"));
-    assert(jsonMemberCheck(jsonMaterial, "ks", "array"));
-    assert(jsonMemberCheck(jsonMaterial, "km", "array"));
-    assert(jsonMemberCheck(jsonMaterial, "name", "string"));
-    assert(jsonMemberCheck(jsonMaterial, "phong_exponent", "number"));
+int Scene::addInstance(int mesh, const glm::mat4 &model, MaterialIndex material) {
+    instances.push_back(MeshInstance());
+    instances.back().mesh = mesh;
+
+    ObjectRef ref = { ObjectType::Mesh, material, static_cast<int>(instances.size()) - 1 };
+    objects.push_back(ref);
 
-    return Material(jsonMaterial["phong_exponent"].GetFloat(),
-                    parseVec3(jsonMaterial["ka"]),
-                    parseVec3(jsonMaterial["kd"]),
-                    parseVec3(jsonMaterial["ks"]),
-                    parseVec3(jsonMaterial["km"]));
+    int id = static_cast<int>(objects.size()) - 1;
+    setTransform(id, model);
+    return id;
 }
 
-static Light parseLight(const rapidjson::Value& jsonLight) {
-    assert(jsonLight.IsObject());
+void Scene::setTransform(int id, const glm::mat4 &model) {
+    MeshInstance &instance = instances[objects[id].index];
 
-    assert(jsonMemberCheck(jsonLight, "type", "string"));
-    assert(jsonMemberCheck(jsonLight, "color", "array"));
+    // the identity keeps rays exactly as they are
+    instance.transformed = model != glm::mat4(1.0f);
+    instance.toWorld = model;
+    instance.toObject = glm::inverse(model);
+    instance.normalToWorld = glm::transpose(glm::mat3(instance.toObject));
 
-    glm::vec3 lightColor = parseVec3(jsonLight["color"]);
+    // normals follow the winding, which a mirroring model turns around
+    if (glm::determinant(glm::mat3(model)) < 0.0f)
+        instance.normalToWorld = instance.normalToWorld * -1.0f;
+}
 
-    glm::vec3 lightDiffuse = 1.0f * lightColor;
-    glm::vec3 lightAmbient = 0.2f * lightDiffuse;
-    glm::vec3 lightSpecular = { 1.0f, 1.0f, 1.0f };
+glm::vec3 MeshInstance::point(const glm::vec3 &p) const {
+    return glm::vec3(toObject * glm::vec4(p, 1.0f));
+}
 
-    std::string lightType = jsonLight["type"].GetString();
+// spelled out, so that packet() gets exactly the same numbers
+glm::vec3 MeshInstance::direction(const glm::vec3 &d) const {
+    const glm::mat4 &m = toObject;
 
-    if (lightType == "point") {
-        assert(jsonMemberCheck(jsonLight, "position", "array"));
-        glm::vec3 lightPosition = parseVec3(jsonLight["position"]);
+    return glm::vec3(m[0][0] * d.x + m[1][0] * d.y + m[2][0] * d.z,
+                     m[0][1] * d.x + m[1][1] * d.y + m[2][1] * d.z,
+                     m[0][2] * d.x + m[1][2] * d.y + m[2][2] * d.z);
+}
 
-        return Light(LightType::Point,
-                     lightPosition,
-                     lightAmbient,
-                     lightDiffuse,
-                     lightSpecular);
-    } else if (lightType == "directional") {
-        assert(jsonMemberCheck(jsonLight, "direction", "array"));
-        glm::vec3 lightDirection = parseVec3(jsonLight["direction"]);
+RayPacket MeshInstance::packet(const RayPacket &rays) const {
+    const glm::mat4 &m = toObject;
+    RayPacket local;
 
-        return Light(LightType::Directional,
-                     lightDirection,
-                     lightAmbient,
-                     lightDiffuse,
-                     lightSpecular);
-    }
-        
-    std::cerr << "Light type not supported " << std::endl;
-    return Light();
+    local.e = point(rays.e);
+    local.dx = PacketFloat(m[0][0]) * rays.dx + PacketFloat(m[1][0]) * rays.dy + PacketFloat(m[2][0]) * rays.dz;
+    local.dy = PacketFloat(m[0][1]) * rays.dx + PacketFloat(m[1][1]) * rays.dy + PacketFloat(m[2][1]) * rays.dz;
+    local.dz = PacketFloat(m[0][2]) * rays.dx + PacketFloat(m[1][2]) * rays.dy + PacketFloat(m[2][2]) * rays.dz;
+    local.invDx = PacketFloat(1.0f) / local.dx;
+    local.invDy = PacketFloat(1.0f) / local.dy;
+    local.invDz = PacketFloat(1.0f) / local.dz;
+    local.active = rays.active;
+
+    return local;
 }
 
-Scene::Scene()
-        : lights{}
-        , objects{} {}
+bool Scene::loadSceneFromJSON(std::string filepath) {
+    MeshLibrary ownLibrary;
+    MeshLibrary &library = meshLibrary ? *meshLibrary : ownLibrary;
+
+    CameraParams cameraParams;
+    if (!readSceneFile(filepath, *this, library, numLoadThreads, cameraParams))
+        return false;
+
+    setCamera(cameraParams, camera);
+    sortKeys(cameraKeys);
+
+    for (MeshAnimation &animation : animations) {
+        sortKeys(animation.keys);
+        animation.model = sampleKeys(animation.keys, 0.0f);
+        setTransform(animation.id, animation.model);
+    }
 
-Scene::Scene(float f,
-             const std::vector<Light> &l,
-             const std::vector<Object3D*> &o)
-        : lights{l}
-        , objects{o} {}
+    buildAccelerationStructure();
+    setFrame(0.0f);
 
-bool Scene::loadSceneFromJSON(std::string filepath){
-    rapidjson::Document document;
+    return true;
+}
 
-    std::string jsonString = readFile(filepath);
-    if (jsonString.empty())
+bool Scene::loadCamerasFromJSON(const std::string &filepath, std::vector<std::pair<std::string, Camera3D>> &cameras) {
+    std::vector<std::pair<std::string, CameraParams>> params;
+    if (!readCameraFile(filepath, params))
         return false;
 
-    rapidjson::ParseResult ok = document.Parse(jsonString.c_str());
-    
-    if (!ok) {
-        std::cerr << "JSON parse error: " << rapidjson::GetParseError_En(ok.Code()) << std::endl;
+    for (const std::pair<std::string, CameraParams> &entry : params) {
+        Camera3D camera;
+        setCamera(entry.second, camera);
+        cameras.push_back(std::make_pair(entry.first, camera));
+    }
+
+    return true;
+}
+
+bool Scene::getBounds(int id, AABB &box) const {
+    const ObjectRef &ref = objects[id];
+
+    switch (ref.type) {
+    case ObjectType::Plane:
         return false;
+    case ObjectType::Sphere:
+        spheres.getBounds(ref.index, box);
+        return true;
+    case ObjectType::Triangle:
+        triangles.getBounds(ref.index, box);
+        return true;
+    case ObjectType::Mesh: {
+        const MeshInstance &instance = instances[ref.index];
+        AABB meshBox;
+
+        if (!meshes[instance.mesh]->getBounds(meshBox))
+            return false;
+
+        if (!instance.transformed) {
+            box = meshBox;
+            return true;
+        }
+
+        // the corners of the box in object space, a little larger for rays
+        // that are rounded a bit differently on the way to object space
+        box = AABB();
+        for (int k = 0; k < 8; k++) {
+            glm::vec3 corner((k & 1) ? meshBox.max.x : meshBox.min.x,
+                             (k & 2) ? meshBox.max.y : meshBox.min.y,
+                             (k & 4) ? meshBox.max.z : meshBox.min.z);
+            box.expand(glm::vec3(instance.toWorld * glm::vec4(corner, 1.0f)));
+        }
+
+        glm::vec3 margin = 1e-5f * (box.max - box.min) + glm::vec3(1e-6f);
+        box = AABB(box.min - margin, box.max + margin);
+        return true;
+    }
     }
 
-    assert(jsonMemberCheck(document, "camera", "object"));
-    assert(jsonMemberCheck(document, "materials", "array"));
-    assert(jsonMemberCheck(document, "lights", "array"));
-    assert(jsonMemberCheck(document, "objects", "array"));
+    return false;
+}
 
-    const rapidjson::Value& jsonCamera = document["camera"];
-    parseCamera(jsonCamera, camera);
-    
-    std::map<std::string, int> materialDict;
-    const rapidjson::Value& jsonMaterials = document["materials"];
+void Scene::buildAccelerationStructure() {
+    std::vector<AABB> bounds;
+    std::vector<int> ids;
+    bounds.reserve(objects.size());
+    ids.reserve(objects.size());
 
-    for (rapidjson::SizeType i = 0; i < jsonMaterials.Size(); i++) {
-        const rapidjson::Value& jsonMaterial = jsonMaterials[i];
+    unbounded.clear();
+    objectBounds.assign(objects.size(), AABB());
 
-        materials.push_back(parseMaterial(jsonMaterial));
-        materialDict[jsonMaterial["name"].GetString()] = i;
+    for (int i = 0; i < static_cast<int>(objects.size()); i++) {
+        AABB &box = objectBounds[i];
+
+        if (getBounds(i, box)) {
+            bounds.push_back(box);
+            ids.push_back(i);
+        } else {
+            unbounded.push_back(i);
+        }
     }
 
-    const rapidjson::Value& jsonLights = document["lights"];
-    for (rapidjson::SizeType i = 0; i < jsonLights.Size(); i++)
-        lights.push_back(parseLight(jsonLights[i]));
+    bvh.build(bounds, ids);
 
-    const rapidjson::Value& jsonObjects = document["objects"];
+    // lay out spheres and triangles in the order the leaves refer to them,
+    // so neighbouring leaves read neighbouring entries of the arrays. Object
+    // ids (and so the tie-breaking between equally near hits) do not change
+    std::vector<int> sphereOrder, triangleOrder;
+    sphereOrder.reserve(spheres.size());
+    triangleOrder.reserve(triangles.size());
 
-    for (rapidjson::SizeType i = 0; i < jsonObjects.Size(); i++) {
-        assert(jsonObjects[i].IsObject());
-        const rapidjson::Value& jsonObject = jsonObjects[i];
+    for (unsigned k = 0; k < bvh.indices.size(); k++) {
+        ObjectRef &ref = objects[bvh.indices[k]];
 
-        assert(jsonMemberCheck(jsonObject, "type", "string"));
-        assert(jsonMemberCheck(jsonObject, "material", "string"));
+        if (ref.type == ObjectType::Sphere) {
+            sphereOrder.push_back(ref.index);
+            ref.index = static_cast<int>(sphereOrder.size()) - 1;
+        } else if (ref.type == ObjectType::Triangle) {
+            triangleOrder.push_back(ref.index);
+            ref.index = static_cast<int>(triangleOrder.size()) - 1;
+        }
+    }
 
-        std::string objectType = jsonObject["type"].GetString();
-        std::string objectMaterialName = jsonObject["material"].GetString();
+    spheres.reorder(sphereOrder);
+    triangles.reorder(triangleOrder);
+}
 
-        int objectMaterialIndex = materialDict[objectMaterialName];
-        Material *objectMaterial = &(materials[objectMaterialIndex]);
+bool Scene::frameRange(int &first, int &last) const {
+    bool found = false;
+    float lo = 0.0f, hi = 0.0f;
 
-        if (objectType == "plane") {
-            assert(jsonMemberCheck(jsonObject, "point", "array"));
-            assert(jsonMemberCheck(jsonObject, "normal", "array"));
+    auto cover = [&](float frame) {
+        lo = found ? std::min(lo, frame) : frame;
+        hi = found ? std::max(hi, frame) : frame;
+        found = true;
+    };
 
-            glm::vec3 objectPoint = parseVec3(jsonObject["point"]);
-            glm::vec3 objectNormal = parseVec3(jsonObject["normal"]);
+    for (const Keyframe<CameraParams> &key : cameraKeys)
+        cover(key.frame);
 
-            objects.push_back(new Plane(objectMaterial,
-                                        objectPoint,
-                                        objectNormal));
-        } else if (objectType == "sphere") {
-            assert(jsonMemberCheck(jsonObject, "radius", "number"));
-            assert(jsonMemberCheck(jsonObject, "center", "array"));
+    for (const MeshAnimation &animation : animations) {
+        for (const Keyframe<glm::mat4> &key : animation.keys)
+            cover(key.frame);
+    }
 
-            float objectRadius = jsonObject["radius"].GetFloat();
-            glm::vec3 objectCenter = parseVec3(jsonObject["center"]);
+    first = static_cast<int>(std::floor(lo));
+    last = static_cast<int>(std::ceil(hi));
+    return found;
+}
+
+void Scene::setFrame(float frame) {
+    if (!cameraKeys.empty())
+        setCamera(sampleKeys(cameraKeys, frame), camera);
 
-            objects.push_back(new Sphere(objectMaterial,
-                                         objectRadius,
-                                         objectCenter));
-        } else if (objectType == "triangle") {
-            assert(jsonMemberCheck(jsonObject, "vertices", "array"));
+    bool moved = false;
 
-            objects.push_back(new Triangle(objectMaterial,
-                                           parseVec3(jsonObject["vertices"][0]),
-                                           parseVec3(jsonObject["vertices"][1]),
-                                           parseVec3(jsonObject["vertices"][2])));
-        } else if (objectType == "mesh") {
-            assert(jsonMemberCheck(jsonObject, "format", "string"));
-            assert(jsonMemberCheck(jsonObject, "filename", "string"));
+    for (MeshAnimation &animation : animations) {
+        glm::mat4 model = sampleKeys(animation.keys, frame);
 
-            std::string meshFormat = jsonObject["format"].GetString();
-            std::string meshFilepath = dirname(filepath) + "/" + jsonObject["filename"].GetString();
+        if (model == animation.model)
+            continue;
+
+        animation.model = model;
+        setTransform(animation.id, model);
+        getBounds(animation.id, objectBounds[animation.id]);
+        moved = true;
+    }
 
-            TriangleMesh *mesh = new TriangleMesh(objectMaterial);
+    if (moved)
+        bvh.refit(objectBounds);
+}
+
+// passes the result of an object test through, counting it if it hit
+static bool countHit(bool hit) {
+    if (hit)
+        SRT_COUNT(Hits);
+    return hit;
+}
 
-            if (meshFormat == "OFF")
-                mesh->readFromOFF(meshFilepath);
+bool Scene::intersect(int id,
+                      const glm::vec3 &e,
+                      const glm::vec3 &d,
+                      float t0,
+                      float &t,
+                      int &prim) const {
+
+    const ObjectRef &ref = objects[id];
+    prim = -1;
+
+    switch (ref.type) {
+    case ObjectType::Plane:
+        SRT_COUNT(PlaneTests);
+        return countHit(planes.intersect(ref.index, e, d, t0, t));
+    case ObjectType::Sphere:
+        SRT_COUNT(SphereTests);
+        return countHit(spheres.intersect(ref.index, e, d, t0, t));
+    case ObjectType::Triangle:
+        SRT_COUNT(TriangleTests);
+        return countHit(triangles.intersect(ref.index, e, d, t0, t));
+    case ObjectType::Mesh: {
+        const MeshInstance &instance = instances[ref.index];
+        const TriangleMesh &mesh = *meshes[instance.mesh];
+
+        if (!instance.transformed)
+            return countHit(mesh.intersect(e, d, t0, t, prim));
+
+        return countHit(mesh.intersect(instance.point(e), instance.direction(d), t0, t, prim));
+    }
+    }
 
-            if (jsonMemberCheck(jsonObject, "model-matrix", "array"))
-                mesh->transform(parseMat4(jsonObject["model-matrix"]));
+    return false;
+}
 
-            objects.push_back(static_cast<Object3D*>(mesh));
+void Scene::intersect(int id, const RayPacket &rays, float t0, PacketHit &hits) const {
+    const ObjectRef &ref = objects[id];
+
+    PacketFloat t;
+    PacketMask mask;
+
+    switch (ref.type) {
+    case ObjectType::Plane:
+        SRT_COUNT(PlaneTests);
+        mask = planes.intersect(ref.index, rays, t0, t);
+        break;
+    case ObjectType::Sphere:
+        SRT_COUNT(SphereTests);
+        mask = spheres.intersect(ref.index, rays, t0, t);
+        break;
+    case ObjectType::Triangle:
+        SRT_COUNT(TriangleTests);
+        mask = triangles.intersect(ref.index, rays, t0, t);
+        break;
+    case ObjectType::Mesh: {
+        const MeshInstance &instance = instances[ref.index];
+        const TriangleMesh &mesh = *meshes[instance.mesh];
+        PacketHit meshHits;
+
+        if (instance.transformed)
+            mesh.intersect(instance.packet(rays), t0, meshHits);
+        else
+            mesh.intersect(rays, t0, meshHits);
+
+        int found = 0;
+        for (int k = 0; k < PACKET_WIDTH; k++) {
+            if (meshHits.idx[k] >= 0)
+                found |= 1 << k;
         }
 
+        mask = PacketHit::laneMask(found);
+        if (!mask.any())
+            return;
+
+        SRT_COUNT(Hits);
+
+        int updated = hits.update(mask, meshHits.t, id);
+        for (int k = 0; k < PACKET_WIDTH; k++) {
+            if ((updated >> k) & 1)
+                hits.prim[k] = meshHits.idx[k];
+        }
+        return;
+    }
     }
 
-    return true;
-}
\ No newline at end of file
+    if (!mask.any())
+        return;
+
+    SRT_COUNT(Hits);
+    hits.update(mask, t, id);
+}
+
+bool Scene::occluded(int id,
+                     const glm::vec3 &e,
+                     const glm::vec3 &d,
+                     float t0,
+                     float t1,
+                     int &prim) const {
+
+    const ObjectRef &ref = objects[id];
+    prim = -1;
+
+    switch (ref.type) {
+    case ObjectType::Plane:
+        SRT_COUNT(PlaneTests);
+        return countHit(planes.occluded(ref.index, e, d, t0, t1));
+    case ObjectType::Sphere:
+        SRT_COUNT(SphereTests);
+        return countHit(spheres.occluded(ref.index, e, d, t0, t1));
+    case ObjectType::Triangle:
+        SRT_COUNT(TriangleTests);
+        return countHit(triangles.occluded(ref.index, e, d, t0, t1));
+    case ObjectType::Mesh: {
+        const MeshInstance &instance = instances[ref.index];
+        const TriangleMesh &mesh = *meshes[instance.mesh];
+
+        if (!instance.transformed)
+            return countHit(mesh.occluded(e, d, t0, t1, prim));
+
+        return countHit(mesh.occluded(instance.point(e), instance.direction(d), t0, t1, prim));
+    }
+    }
+
+    return false;
+}
+
+bool Scene::occluded(const glm::vec3 &e,
+                     const glm::vec3 &d,
+                     float t0,
+                     float t1,
+                     int &id,
+                     int &prim) const {
+
+    int hitId = -1;
+    int hitPrim = -1;
+
+    // tMax is the end of the range the walk is still searching, t1 as
+    // nothing shrinks it before the first hit ends the walk
+    auto test = [&](int k, float &tMax) {
+        int p;
+
+        if (!occluded(k, e, d, t0, tMax, p))
+            return false;
+
+        hitId = k;
+        hitPrim = p;
+        return true;
+    };
+
+    float tMax = t1;
+    bool hit = false;
+
+    for (int k = 0; k < static_cast<int>(unbounded.size()) && !hit; k++)
+        hit = test(unbounded[k], tMax);
+
+    if (!hit)
+        hit = bvh.traverse(e, d, t0, t1, test);
+
+    id = hitId;
+    prim = hitPrim;
+    return hit;
+}
+
+bool Scene::occludedBy(int id,
+                       int prim,
+                       const glm::vec3 &e,
+                       const glm::vec3 &d,
+                       float t0,
+                       float t1) const {
+
+    if (id >= static_cast<int>(objectBounds.size()))
+        return false;
+
+    // only report what the BVH walk would find as well: the ray has to pass
+    // the object's own box, which every node above it contains. So the
+    // answer never depends on what was tested first. The box is the one the
+    // BVH has, objects outside of it have none
+    const AABB &box = objectBounds[id];
+    glm::vec3 invD(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+
+    if (!box.empty() && !box.intersectRay(e, invD, t0, t1))
+        return false;
+
+    const ObjectRef &ref = objects[id];
+
+    if (ref.type == ObjectType::Mesh && prim >= 0) {
+        const MeshInstance &instance = instances[ref.index];
+        const TriangleMesh &mesh = *meshes[instance.mesh];
+
+        if (!instance.transformed)
+            return countHit(mesh.occluded(prim, e, d, t0, t1));
+
+        return countHit(mesh.occluded(prim, instance.point(e), instance.direction(d), t0, t1));
+    }
+
+    int hitPrim;
+    return occluded(id, e, d, t0, t1, hitPrim);
+}
+
+glm::vec3 Scene::normal(int id, int prim, const glm::vec3 &hit) const {
+    const ObjectRef &ref = objects[id];
+
+    switch (ref.type) {
+    case ObjectType::Plane:
+        return planes.normal(ref.index);
+    case ObjectType::Sphere:
+        return spheres.normal(ref.index, hit);
+    case ObjectType::Triangle:
+        return triangles.normal(ref.index);
+    case ObjectType::Mesh: {
+        const MeshInstance &instance = instances[ref.index];
+        glm::vec3 n = meshes[instance.mesh]->normal(prim);
+
+        return instance.transformed ? glm::normalize(instance.normalToWorld * n) : n;
+    }
+    }
+
+    return glm::vec3(0.0f);
+}
+
+const Material &Scene::material(int id) const {
+    return materials[objects[id].material];
+}
+
+MaterialIndex Scene::materialIndex(int id) const {
+    return objects[id].material;
+}
@@ -2,33 +2,154 @@
 
 #include <map>
 #include <cmath>
+#include <memory>
 #include <string>
 #include <vector>
 #include <cstddef>
+#include <utility>
 #include <fstream>
 #include <iostream>
 
+#include "BVH.h"
 #include "Light.h"
+#include "Packet.h"
 #include "Camera3D.h"
-#include "Object3D.h"
+#include "Material.h"
+#include "MeshCache.h"
+#include "MeshLibrary.h"
+#include "Primitives.h"
+#include "TriangleMesh.h"
 
 #include <glm/glm.hpp>
 #include <glm/gtx/string_cast.hpp>
 
-#include "rapidjson/document.h"
-#include "rapidjson/prettywriter.h"
-#include "rapidjson/error/en.h"
 
+enum class ObjectType : unsigned char { Plane, Sphere, Triangle, Mesh };
+
+// what an object id refers to: entry index of the array for its type
+struct ObjectRef {
+    ObjectType type;
+    MaterialIndex material;     // into Scene::materials
+    int index;
+};
+
+// the members of a camera in a scene file, which camera keyframes change
+struct CameraParams {
+    float focalLength;
+    float width, height;
+    glm::vec3 eye, up, look;
+};
+
+template <typename T>
+struct Keyframe {
+    float frame;
+    T value;
+};
+
+// a mesh placed in the scene. The triangles and their BVH stay in object
+// space, shared by every instance of the mesh, and rays are taken there
+// instead. Directions are not normalized on the way, so t is the same in
+// both spaces
+struct MeshInstance {
+    int mesh;                 // index into Scene::meshes
+    bool transformed;         // false when object space is world space
+    glm::mat4 toWorld;
+    glm::mat4 toObject;
+    glm::mat3 normalToWorld;  // inverse transpose of toWorld
+
+    glm::vec3 point(const glm::vec3 &p) const;
+    glm::vec3 direction(const glm::vec3 &d) const;
+    RayPacket packet(const RayPacket &rays) const;
+};
+
+// a mesh instance with "keyframes" instead of a fixed model matrix, only its
+// transform changes from frame to frame
+struct MeshAnimation {
+    int id;                 // object id
+    std::vector<Keyframe<glm::mat4>> keys;
+    glm::mat4 model;        // where it is now
+};
 
 class Scene {
 public:
     Camera3D camera;
-    std::vector<Material> materials;
+    MaterialTable materials;
     std::vector<Light> lights;
-    std::vector<Object3D*> objects;
+
+    // one entry per object in the order they were declared, the position is
+    // the object id. The geometry lives in the per type arrays
+    std::vector<ObjectRef> objects;
+    PlaneArray planes;
+    SphereArray spheres;
+    TriangleArray triangles;
+    std::vector<std::shared_ptr<const TriangleMesh>> meshes;  // may be shared with other scenes
+    std::vector<MeshInstance> instances;  // what mesh objects refer to
+
+    BVH bvh;                     // over every bounded object
+    std::vector<int> unbounded;  // objects kept outside the BVH (planes)
+    std::vector<AABB> objectBounds;  // per object id, what bvh was built (or refit) from
+
+    // keyframes sorted by frame. Camera members are interpolated linearly
+    // between keys, model matrices by their translation, rotation (slerp)
+    // and scale. The first and last keys hold before and after them
+    std::vector<Keyframe<CameraParams>> cameraKeys;
+    std::vector<MeshAnimation> animations;
+
+    // meshes are read from (and saved to) a binary cache next to their file
+    bool useMeshCache;
+    // when set, meshes come from (and are added to) this library instead
+    // of being loaded for this scene alone
+    MeshLibrary *meshLibrary;
+    // threads that read the mesh files of a scene, once its JSON file is read
+    int numLoadThreads;
 
     Scene();
-    Scene(float f, const std::vector<Light> &l, const std::vector<Object3D*> &o);
 
+    int addPlane(const glm::vec3 &point, const glm::vec3 &normal, MaterialIndex material);
+    int addSphere(const glm::vec3 &center, float radius, MaterialIndex material);
+    int addTriangle(const glm::vec3 &a, const glm::vec3 &b, const glm::vec3 &c, MaterialIndex material);
+    // a new mesh and one instance of it where the mesh is
+    int addMesh(TriangleMesh &&mesh, MaterialIndex material);
+    int addMesh(std::shared_ptr<const TriangleMesh> mesh, MaterialIndex material);
+    // another instance of meshes[mesh], placed by model
+    int addInstance(int mesh, const glm::mat4 &model, MaterialIndex material);
+    // moves the instance of mesh object id, call buildAccelerationStructure()
+    // (or setFrame()) before tracing again
+    void setTransform(int id, const glm::mat4 &model);
+
+    // false, after printing what is wrong with it, for a file that cannot
+    // be read or is not a valid scene (see SceneReader.h)
     bool loadSceneFromJSON(std::string filepath);
+    // a JSON array of cameras with the same members as the "camera" of a
+    // scene, plus an optional "name" (the index otherwise)
+    static bool loadCamerasFromJSON(const std::string &filepath, std::vector<std::pair<std::string, Camera3D>> &cameras);
+    void buildAccelerationStructure();
+
+    // frames from the first to the last keyframe, false for a still scene
+    bool frameRange(int &first, int &last) const;
+    // moves the camera and the animated meshes to frame. Only the instances
+    // that moved get new transforms and bvh is refit over them, the meshes
+    // and other objects are left alone
+    void setFrame(float frame);
+    // box of object id, false for unbounded objects (planes)
+    bool getBounds(int id, AABB &box) const;
+
+    // nearest t beyond t0 of object id along (e, d), prim is the triangle of
+    // a mesh (-1 otherwise)
+    bool intersect(int id, const glm::vec3 &e, const glm::vec3 &d, float t0, float &t, int &prim) const;
+    // packet version, updates the lanes where object id is hit beyond t0
+    // and nearer than the current hit
+    void intersect(int id, const RayPacket &rays, float t0, PacketHit &hits) const;
+    // whether any object is hit with t in (t0, t1), stops at the first one
+    // found. id and prim get that object and its triangle (-1 if none)
+    bool occluded(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, int &id, int &prim) const;
+    // any hit of object id with t in (t0, t1), without looking for the nearest
+    // one. prim gets the triangle of a mesh that was hit (-1 otherwise)
+    bool occluded(int id, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, int &prim) const;
+    // the same for one triangle of a mesh, or the whole object if prim < 0
+    bool occludedBy(int id, int prim, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const;
+    // normal at the hit point of a ray that hit (id, prim)
+    glm::vec3 normal(int id, int prim, const glm::vec3 &hit) const;
+    const Material &material(int id) const;
+    MaterialIndex materialIndex(int id) const;
 };
@@ -0,0 +1,900 @@
+#include "SceneReader.h"
+
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <functional>
+#include <unordered_map>
+
+#include "TileScheduler.h"
+
+#include "rapidjson/reader.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/error/en.h"
+
+// the file is read in blocks of this many bytes
+static const size_t READ_BUFFER_SIZE = 1 << 16;
+
+static std::string dirname(std::string filepath) {
+    #if defined(WIN32) || defined(_WIN32)
+        std::size_t slash = filepath.find("\\");
+        while (slash != std::string::npos) {
+            filepath.replace(slash, 1, "/");
+            slash = filepath.find("\\");
+        }
+    #endif
+
+    std::size_t pos = filepath.find_last_of("/");
+
+    if (pos == std::string::npos)
+        return "";
+
+    return filepath.substr(0, pos);
+}
+
+// a FileReadStream that counts lines, for the error messages
+class LineStream {
+public:
+    typedef char Ch;
+
+    int line;
+
+    explicit LineStream(rapidjson::FileReadStream &stream)
+            : line{1}
+            , stream(stream) {}
+
+    Ch Peek() const { return stream.Peek(); }
+    size_t Tell() const { return stream.Tell(); }
+
+    Ch Take() {
+        Ch c = stream.Take();
+        if (c == '\n')
+            line++;
+        return c;
+    }
+
+    // only used for in situ parsing
+    Ch *PutBegin() { RAPIDJSON_ASSERT(false); return 0; }
+    void Put(Ch) { RAPIDJSON_ASSERT(false); }
+    void Flush() { RAPIDJSON_ASSERT(false); }
+    size_t PutEnd(Ch *) { RAPIDJSON_ASSERT(false); return 0; }
+
+private:
+    rapidjson::FileReadStream &stream;
+};
+
+enum class JsonKind : unsigned char { Null, Bool, Number, String, Numbers, Records, Other };
+
+// a member of an object of the file. Arrays of numbers, nested ones too,
+// keep the numbers in order and the size of their arrays per level ({4, 4}
+// for a matrix); regular is false when arrays of one level differ in size
+// or not all numbers are in the innermost arrays. Arrays of objects keep
+// those as records of their own
+struct JsonField {
+    std::string name;
+    JsonKind kind;
+    float number;
+    std::string string;
+    std::vector<float> numbers;
+    std::vector<int> shape;
+    int numberLevel;
+    bool regular;
+    std::vector<int> records;   // into ElementReader::records
+
+    void reset(const char *s, size_t length) {
+        name.assign(s, length);
+        kind = JsonKind::Null;
+        number = 0.0f;
+        string.clear();
+        numbers.clear();
+        shape.clear();
+        numberLevel = 0;
+        regular = true;
+        records.clear();
+    }
+};
+
+// an object of the file, its members in the order they came in. Only the
+// first numFields fields are in use, the others are kept for their memory
+struct JsonRecord {
+    std::vector<JsonField> fields;
+    int numFields;
+
+    JsonField &add(const char *name, size_t length) {
+        if (numFields == static_cast<int>(fields.size()))
+            fields.emplace_back();
+
+        JsonField &field = fields[numFields++];
+        field.reset(name, length);
+        return field;
+    }
+
+    const JsonField *find(const char *name) const {
+        for (int i = 0; i < numFields; i++) {
+            if (fields[i].name == name)
+                return &fields[i];
+        }
+        return nullptr;
+    }
+};
+
+// Takes the events of the SAX Reader and collects the elements of the file
+// one at a time: for a scene file its camera and every entry of its
+// materials, lights and objects, for a camera file every entry of the array
+// it is. Once an element ends it is handed to elementDone and its records
+// are reused for the next one. Other members of a scene are skipped
+class ElementReader : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, ElementReader> {
+public:
+    typedef std::function<bool(ElementReader &reader, const std::string &section, int index, const JsonRecord &element)> ElementDone;
+
+    std::vector<JsonRecord> records;    // records[0] is the element
+    std::vector<std::string> sections;  // the arrays of the scene found so far
+    std::string error;
+    const LineStream *lines;            // while the file is parsed
+
+    ElementReader(bool cameraFile, const ElementDone &elementDone)
+            : lines{nullptr}
+            , cameraFile{cameraFile}
+            , elementDone(elementDone)
+            , depth{0}
+            , skipped{0}
+            , index{0}
+            , numRecords{0} {}
+
+    bool Null() { return scalar(JsonKind::Null, 0.0, nullptr, 0); }
+    bool Bool(bool) { return scalar(JsonKind::Bool, 0.0, nullptr, 0); }
+    bool Int(int i) { return scalar(JsonKind::Number, i, nullptr, 0); }
+    bool Uint(unsigned i) { return scalar(JsonKind::Number, i, nullptr, 0); }
+    bool Int64(int64_t i) { return scalar(JsonKind::Number, static_cast<double>(i), nullptr, 0); }
+    bool Uint64(uint64_t i) { return scalar(JsonKind::Number, static_cast<double>(i), nullptr, 0); }
+    bool Double(double d) { return scalar(JsonKind::Number, d, nullptr, 0); }
+    bool String(const char *s, rapidjson::SizeType length, bool) { return scalar(JsonKind::String, 0.0, s, length); }
+
+    bool Key(const char *s, rapidjson::SizeType length, bool) {
+        if (skipped > 0)
+            return true;
+
+        if (open.empty())
+            key.assign(s, length);
+        else
+            records[open.back().record].add(s, length);
+
+        return true;
+    }
+
+    bool StartObject() {
+        if (skipped > 0) {
+            skipped++;
+            return true;
+        }
+
+        if (!open.empty()) {
+            OpenRecord &o = open.back();
+            JsonField &field = current();
+
+            // an entry of an array of objects
+            if (o.arrays == 1 && (field.kind == JsonKind::Records || (field.kind == JsonKind::Numbers && field.shape.empty() && field.numbers.empty()))) {
+                // the records may move, so the field is looked up again
+                int record = newRecord();
+                JsonField &entries = current();
+
+                entries.kind = JsonKind::Records;
+                entries.records.push_back(record);
+                open.push_back(OpenRecord{ record, 0 });
+                return true;
+            }
+
+            field.kind = JsonKind::Other;
+            skipped = 1;
+            return true;
+        }
+
+        if (depth == 0) {
+            if (cameraFile)
+                return fail("not an array of cameras");
+            depth = 1;
+            return true;
+        }
+
+        if (atElement()) {
+            if (!cameraFile && depth == 1)
+                section = key;
+            numRecords = 0;
+            open.push_back(OpenRecord{ newRecord(), 0 });
+            return true;
+        }
+
+        if (atSection())
+            return fail("\"" + key + "\" is not an array");
+
+        skipped = 1;
+        return true;
+    }
+
+    bool EndObject(rapidjson::SizeType) {
+        if (skipped > 0) {
+            skipped--;
+            return true;
+        }
+
+        if (open.empty()) {
+            depth--;
+            return true;
+        }
+
+        open.pop_back();
+        if (!open.empty())
+            return true;
+
+        if (!elementDone(*this, section, index, records[0])) {
+            error = describe(section, index) + ": " + error;
+            return false;
+        }
+
+        index++;
+        return true;
+    }
+
+    bool StartArray() {
+        if (skipped > 0) {
+            skipped++;
+            return true;
+        }
+
+        if (!open.empty()) {
+            OpenRecord &o = open.back();
+            JsonField &field = current();
+
+            o.arrays++;
+            if (o.arrays == 1)
+                field.kind = JsonKind::Numbers;
+            else if (field.kind != JsonKind::Numbers)
+                field.kind = JsonKind::Other;
+            return true;
+        }
+
+        if (depth == 0) {
+            if (!cameraFile)
+                return fail("not a JSON object");
+            section = "cameras";
+            depth = 1;
+            index = 0;
+            return true;
+        }
+
+        if (atElement())
+            return fail(describe(cameraFile ? "cameras" : key, index) + " is not an object");
+
+        if (atSection()) {
+            sections.push_back(key);
+            section = key;
+            depth = 2;
+            index = 0;
+            return true;
+        }
+
+        skipped = 1;
+        return true;
+    }
+
+    bool EndArray(rapidjson::SizeType n) {
+        if (skipped > 0) {
+            skipped--;
+            return true;
+        }
+
+        if (open.empty()) {
+            depth--;
+            return true;
+        }
+
+        OpenRecord &o = open.back();
+        JsonField &field = current();
+
+        if (field.kind == JsonKind::Numbers) {
+            size_t level = static_cast<size_t>(o.arrays);
+            if (field.shape.size() < level)
+                field.shape.resize(level, -1);
+
+            if (field.shape[level - 1] < 0)
+                field.shape[level - 1] = static_cast<int>(n);
+            else if (field.shape[level - 1] != static_cast<int>(n))
+                field.regular = false;
+        }
+
+        o.arrays--;
+        return true;
+    }
+
+    int line() const {
+        return lines ? lines->line : 0;
+    }
+
+    bool fail(const std::string &message) {
+        error = message;
+        return false;
+    }
+
+    bool has(const JsonRecord &record, const char *name) const {
+        return record.find(name) != nullptr;
+    }
+
+    bool getNumber(const JsonRecord &record, const char *name, float &value) {
+        const JsonField *field = member(record, name);
+        if (!field)
+            return false;
+
+        if (field->kind != JsonKind::Number)
+            return wrongType(name, "a number");
+
+        value = field->number;
+        return true;
+    }
+
+    bool getString(const JsonRecord &record, const char *name, std::string &value) {
+        const JsonField *field = member(record, name);
+        if (!field)
+            return false;
+
+        if (field->kind != JsonKind::String)
+            return wrongType(name, "a string");
+
+        value = field->string;
+        return true;
+    }
+
+    bool getVec3(const JsonRecord &record, const char *name, glm::vec3 &v) {
+        const float *values = numbers(record, name, 3, 0, "an array of 3 numbers");
+        if (!values)
+            return false;
+
+        v = glm::vec3(values[0], values[1], values[2]);
+        return true;
+    }
+
+    // rows of numbers, each a column of the matrix
+    bool getMat4(const JsonRecord &record, const char *name, glm::mat4 &m) {
+        const float *values = numbers(record, name, 4, 4, "4 arrays of 4 numbers");
+        if (!values)
+            return false;
+
+        for (int r = 0; r < 4; r++) {
+            for (int c = 0; c < 4; c++)
+                m[c][r] = values[4 * r + c];
+        }
+        return true;
+    }
+
+    bool getTriangle(const JsonRecord &record, const char *name, glm::vec3 vertices[3]) {
+        const float *values = numbers(record, name, 3, 3, "3 arrays of 3 numbers");
+        if (!values)
+            return false;
+
+        for (int k = 0; k < 3; k++)
+            vertices[k] = glm::vec3(values[3 * k], values[3 * k + 1], values[3 * k + 2]);
+        return true;
+    }
+
+    // the records of an array of objects, an empty array has none
+    bool getRecords(const JsonRecord &record, const char *name, const std::vector<int> *&indices) {
+        const JsonField *field = member(record, name);
+        if (!field)
+            return false;
+
+        bool empty = field->kind == JsonKind::Numbers && field->shape.size() == 1 && field->shape[0] == 0;
+        if (field->kind != JsonKind::Records && !empty)
+            return wrongType(name, "an array of objects");
+
+        indices = &field->records;
+        return true;
+    }
+
+private:
+    struct OpenRecord {
+        int record;
+        int arrays;     // how deep in arrays the last field of record is
+    };
+
+    bool cameraFile;
+    ElementDone elementDone;
+
+    int depth;      // of the objects and arrays around the elements
+    int skipped;    // open objects and arrays that are skipped
+    std::string key;        // last member of the scene
+    std::string section;    // of the element, "camera" or the array it is in
+    int index;              // of the element in its section
+    std::vector<OpenRecord> open;
+    int numRecords;
+
+    bool atSection() const {
+        return !cameraFile && depth == 1 && (key == "materials" || key == "lights" || key == "objects");
+    }
+
+    bool atElement() const {
+        return cameraFile ? depth == 1 : (depth == 2 || (depth == 1 && key == "camera"));
+    }
+
+    static std::string describe(const std::string &section, int index) {
+        if (section == "camera")
+            return "the camera";
+
+        // the name of an entry is the section without its plural s
+        return section.substr(0, section.size() - 1) + " " + std::to_string(index);
+    }
+
+    JsonField &current() {
+        JsonRecord &record = records[open.back().record];
+        return record.fields[record.numFields - 1];
+    }
+
+    int newRecord() {
+        if (numRecords == static_cast<int>(records.size()))
+            records.emplace_back();
+
+        records[numRecords].numFields = 0;
+        return numRecords++;
+    }
+
+    bool scalar(JsonKind kind, double number, const char *s, size_t length) {
+        if (skipped > 0)
+            return true;
+
+        if (open.empty()) {
+            if (depth == 0)
+                return fail(cameraFile ? "not an array of cameras" : "not a JSON object");
+            if (atElement())
+                return fail(describe(cameraFile ? "cameras" : key, index) + " is not an object");
+            if (atSection())
+                return fail("\"" + key + "\" is not an array");
+            return true;
+        }
+
+        const OpenRecord &o = open.back();
+        JsonField &field = current();
+
+        if (o.arrays == 0) {
+            field.kind = kind;
+            field.number = static_cast<float>(number);
+            if (s)
+                field.string.assign(s, length);
+        } else if (kind == JsonKind::Number && field.kind == JsonKind::Numbers) {
+            field.numbers.push_back(static_cast<float>(number));
+
+            if (field.numberLevel == 0)
+                field.numberLevel = o.arrays;
+            else if (field.numberLevel != o.arrays)
+                field.regular = false;
+        } else {
+            field.kind = JsonKind::Other;
+        }
+
+        return true;
+    }
+
+    const JsonField *member(const JsonRecord &record, const char *name) {
+        const JsonField *field = record.find(name);
+        if (!field)
+            fail(std::string("\"") + name + "\" is missing");
+        return field;
+    }
+
+    bool wrongType(const char *name, const char *what) {
+        return fail(std::string("\"") + name + "\" is not " + what);
+    }
+
+    // the numbers of an array of rows arrays of columns numbers, or of
+    // rows numbers when columns is 0
+    const float *numbers(const JsonRecord &record, const char *name, int rows, int columns, const char *what) {
+        const JsonField *field = member(record, name);
+        if (!field)
+            return nullptr;
+
+        size_t levels = columns > 0 ? 2 : 1;
+        size_t count = static_cast<size_t>(rows) * (columns > 0 ? columns : 1);
+
+        bool ok = field->kind == JsonKind::Numbers
+               && field->regular
+               && field->shape.size() == levels
+               && field->shape[0] == rows
+               && (columns == 0 || field->shape[1] == columns)
+               && field->numbers.size() == count;
+
+        if (!ok) {
+            wrongType(name, what);
+            return nullptr;
+        }
+
+        return field->numbers.data();
+    }
+};
+
+// what the scene file and its keyframes give a camera. The members of a
+// keyframe are optional, those it lacks stay as in params
+static bool parseCameraMembers(ElementReader &reader, const JsonRecord &record, bool required, CameraParams &params) {
+    struct { const char *name; float *value; } numbers[] = {
+        { "focal_length", &params.focalLength },
+        { "width", &params.width },
+        { "height", &params.height }
+    };
+    struct { const char *name; glm::vec3 *value; } vectors[] = {
+        { "eye", &params.eye },
+        { "up", &params.up },
+        { "look", &params.look }
+    };
+
+    for (auto &number : numbers) {
+        if ((required || reader.has(record, number.name)) && !reader.getNumber(record, number.name, *number.value))
+            return false;
+    }
+
+    for (auto &vector : vectors) {
+        if ((required || reader.has(record, vector.name)) && !reader.getVec3(record, vector.name, *vector.value))
+            return false;
+    }
+
+    return true;
+}
+
+// keys is null where keyframes are not read (camera files)
+static bool parseCamera(ElementReader &reader, const JsonRecord &record, CameraParams &params, std::vector<Keyframe<CameraParams>> *keys) {
+    std::string type;
+    if (!reader.getString(record, "type", type))
+        return false;
+
+    if (type != "perspective")
+        return reader.fail("only perspective cameras are supported");
+
+    if (!parseCameraMembers(reader, record, true, params))
+        return false;
+
+    if (!keys || !reader.has(record, "keyframes"))
+        return true;
+
+    const std::vector<int> *jsonKeys = nullptr;
+    if (!reader.getRecords(record, "keyframes", jsonKeys))
+        return false;
+
+    for (size_t k = 0; k < jsonKeys->size(); k++) {
+        const JsonRecord &jsonKey = reader.records[(*jsonKeys)[k]];
+        Keyframe<CameraParams> key = { 0.0f, params };
+
+        if (!reader.getNumber(jsonKey, "frame", key.frame) || !parseCameraMembers(reader, jsonKey, false, key.value))
+            return reader.fail("keyframe " + std::to_string(k) + ": " + reader.error);
+
+        keys->push_back(key);
+    }
+
+    return true;
+}
+
+static bool parseMaterial(ElementReader &reader, const JsonRecord &record, Material &material) {
+    return reader.getVec3(record, "ka", material.ka)
+        && reader.getVec3(record, "kd", material.kd)
+        && reader.getVec3(record, "ks", material.ks)
+        && reader.getVec3(record, "km", material.km)
+        && reader.getNumber(record, "phong_exponent", material.shiness);
+}
+
+static bool parseLight(ElementReader &reader, const JsonRecord &record, Light &light) {
+    std::string type;
+    glm::vec3 color, v;
+
+    if (!reader.getString(record, "type", type) || !reader.getVec3(record, "color", color))
+        return false;
+
+    glm::vec3 diffuse = 1.0f * color;
+    glm::vec3 ambient = 0.2f * diffuse;
+    glm::vec3 specular = { 1.0f, 1.0f, 1.0f };
+
+    if (type == "point") {
+        if (!reader.getVec3(record, "position", v))
+            return false;
+        light = Light(LightType::Point, v, ambient, diffuse, specular);
+    } else if (type == "directional") {
+        if (!reader.getVec3(record, "direction", v))
+            return false;
+        light = Light(LightType::Directional, v, ambient, diffuse, specular);
+    } else {
+        return reader.fail("light type \"" + type + "\" is not supported");
+    }
+
+    return true;
+}
+
+static bool parseModelKeys(ElementReader &reader, const std::vector<int> &jsonKeys, std::vector<Keyframe<glm::mat4>> &keys) {
+    for (size_t k = 0; k < jsonKeys.size(); k++) {
+        const JsonRecord &jsonKey = reader.records[jsonKeys[k]];
+        Keyframe<glm::mat4> key = { 0.0f, glm::mat4(1.0f) };
+
+        if (!reader.getNumber(jsonKey, "frame", key.frame) || !reader.getMat4(jsonKey, "model-matrix", key.value))
+            return reader.fail("keyframe " + std::to_string(k) + ": " + reader.error);
+
+        keys.push_back(key);
+    }
+
+    return true;
+}
+
+// builds the scene from the elements of the file as they come
+class SceneBuilder {
+public:
+    CameraParams cameraParams;
+    bool hasCamera;
+
+    SceneBuilder(const std::string &filepath, Scene &scene)
+            : hasCamera{false}
+            , folder{dirname(filepath)}
+            , scene(scene)
+            , firstObject{static_cast<int>(scene.objects.size())} {}
+
+    bool add(ElementReader &reader, const std::string &section, const JsonRecord &element) {
+        if (section == "camera") {
+            hasCamera = true;
+            return parseCamera(reader, element, cameraParams, &scene.cameraKeys);
+        }
+
+        if (section == "materials") {
+            Material material;
+            std::string name;
+
+            if (!reader.getString(element, "name", name) || !parseMaterial(reader, element, material))
+                return false;
+
+            if (scene.materials.add(material, name) < 0) {
+                if (scene.materials.size() >= MaterialTable::MAX_SIZE)
+                    return reader.fail("more than " + std::to_string(MaterialTable::MAX_SIZE) + " materials");
+                return reader.fail("material \"" + name + "\" is defined twice");
+            }
+            return true;
+        }
+
+        if (section == "lights") {
+            Light light;
+            if (!parseLight(reader, element, light))
+                return false;
+
+            scene.lights.push_back(light);
+            return true;
+        }
+
+        return addObject(reader, element);
+    }
+
+    // the materials of the objects, which may be defined after them, once
+    // the whole file is read
+    bool resolveMaterials(const std::string &filepath) {
+        std::vector<MaterialIndex> resolved(uses.size());
+
+        for (size_t u = 0; u < uses.size(); u++) {
+            if (!scene.materials.find(uses[u].name, resolved[u])) {
+                std::cerr << filepath << ":" << uses[u].line << ": object " << uses[u].object
+                          << ": unknown material \"" << uses[u].name << "\"" << std::endl;
+                return false;
+            }
+        }
+
+        for (size_t k = 0; k < objectUses.size(); k++)
+            scene.objects[firstObject + k].material = resolved[objectUses[k]];
+
+        return true;
+    }
+
+    // every mesh file once, on numThreads threads. Their meshes go where the
+    // instances expect them in scene.meshes. False (after printing which
+    // object uses it) if a file cannot be read
+    bool loadMeshes(const std::string &filepath, MeshLibrary &library, int numThreads) {
+        TileScheduler scheduler(static_cast<int>(meshFiles.size()), 1, 1);
+        WorkerPool workers(std::min(numThreads, scheduler.numTiles()));
+
+        scheduler.run(workers, [&](const Tile &tile) {
+            const MeshFile &file = meshFiles[tile.x0];
+            scene.meshes[file.mesh] = library.loadOFF(file.path, scene.useMeshCache);
+        });
+
+        for (const MeshFile &file : meshFiles) {
+            if (!scene.meshes[file.mesh]) {
+                std::cerr << filepath << ":" << file.line << ": object " << file.object
+                          << ": cannot read mesh \"" << file.path << "\"" << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+private:
+    // a material name and the first object that uses it
+    struct MaterialUse {
+        std::string name;
+        int object;
+        int line;
+    };
+
+    // a mesh file and the first object that uses it
+    struct MeshFile {
+        std::string path;
+        int mesh;   // into Scene::meshes
+        int object;
+        int line;
+    };
+
+    std::string folder;     // that mesh file names are relative to
+    Scene &scene;
+
+    int firstObject;
+    std::vector<MaterialUse> uses;
+    std::unordered_map<std::string, int> useIndices;
+    std::vector<int> objectUses;    // per object, from firstObject on
+
+    std::vector<MeshFile> meshFiles;
+    std::unordered_map<std::string, int> meshIndices;
+
+    bool addObject(ElementReader &reader, const JsonRecord &element) {
+        std::string type, materialName;
+
+        if (!reader.getString(element, "type", type) || !reader.getString(element, "material", materialName))
+            return false;
+
+        int object = static_cast<int>(objectUses.size());
+        auto found = useIndices.find(materialName);
+
+        if (found == useIndices.end()) {
+            found = useIndices.insert(std::make_pair(materialName, static_cast<int>(uses.size()))).first;
+            uses.push_back(MaterialUse{ materialName, object, reader.line() });
+        }
+
+        // material 0 until resolveMaterials
+        if (type == "plane") {
+            glm::vec3 point, normal;
+            if (!reader.getVec3(element, "point", point) || !reader.getVec3(element, "normal", normal))
+                return false;
+
+            scene.addPlane(point, normal, 0);
+        } else if (type == "sphere") {
+            float radius = 0.0f;
+            glm::vec3 center;
+            if (!reader.getNumber(element, "radius", radius) || !reader.getVec3(element, "center", center))
+                return false;
+
+            scene.addSphere(center, radius, 0);
+        } else if (type == "triangle") {
+            glm::vec3 vertices[3];
+            if (!reader.getTriangle(element, "vertices", vertices))
+                return false;
+
+            scene.addTriangle(vertices[0], vertices[1], vertices[2], 0);
+        } else if (type == "mesh") {
+            if (!addMeshObject(reader, element, object))
+                return false;
+        } else {
+            return reader.fail("object type \"" + type + "\" is not supported");
+        }
+
+        objectUses.push_back(found->second);
+        return true;
+    }
+
+    bool addMeshObject(ElementReader &reader, const JsonRecord &element, int object) {
+        std::string format, filename;
+        if (!reader.getString(element, "format", format) || !reader.getString(element, "filename", filename))
+            return false;
+
+        glm::mat4 model(1.0f);
+        if (reader.has(element, "model-matrix") && !reader.getMat4(element, "model-matrix", model))
+            return false;
+
+        if (format != "OFF")
+            return reader.fail("mesh format \"" + format + "\" is not supported");
+
+        // read later, only a place in scene.meshes for now
+        std::string path = folder + "/" + filename;
+        auto found = meshIndices.find(path);
+
+        if (found == meshIndices.end()) {
+            scene.meshes.push_back(nullptr);
+            found = meshIndices.insert(std::make_pair(path, static_cast<int>(scene.meshes.size()) - 1)).first;
+            meshFiles.push_back(MeshFile{ path, found->second, object, reader.line() });
+        }
+
+        const std::vector<int> *jsonKeys = nullptr;
+        if (reader.has(element, "keyframes") && !reader.getRecords(element, "keyframes", jsonKeys))
+            return false;
+
+        if (jsonKeys && !jsonKeys->empty()) {
+            MeshAnimation animation;
+            if (!parseModelKeys(reader, *jsonKeys, animation.keys))
+                return false;
+
+            animation.model = glm::mat4(1.0f);
+            animation.id = scene.addInstance(found->second, animation.model, 0);
+            scene.animations.push_back(animation);
+            return true;
+        }
+
+        scene.addInstance(found->second, model, 0);
+        return true;
+    }
+};
+
+// runs the SAX Reader over filepath into reader, false (after printing
+// why) when the file cannot be read or reader finds an error in it
+static bool parseFile(const std::string &filepath, ElementReader &reader) {
+    std::FILE *file = std::fopen(filepath.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Failed to open " << filepath << std::endl;
+        return false;
+    }
+
+    std::vector<char> buffer(READ_BUFFER_SIZE);
+    rapidjson::FileReadStream fileStream(file, buffer.data(), buffer.size());
+    LineStream stream(fileStream);
+    reader.lines = &stream;
+
+    rapidjson::Reader parser;
+    rapidjson::ParseResult ok = parser.Parse(stream, reader);
+
+    reader.lines = nullptr;
+    std::fclose(file);
+
+    if (!ok) {
+        std::cerr << filepath << ":" << stream.line << ": "
+                  << (reader.error.empty() ? rapidjson::GetParseError_En(ok.Code()) : reader.error) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool readSceneFile(const std::string &filepath,
+                   Scene &scene,
+                   MeshLibrary &library,
+                   int numThreads,
+                   CameraParams &cameraParams) {
+
+    SceneBuilder builder(filepath, scene);
+    ElementReader reader(false, [&](ElementReader &reader, const std::string &section, int, const JsonRecord &element) {
+        return builder.add(reader, section, element);
+    });
+
+    if (!parseFile(filepath, reader))
+        return false;
+
+    if (!builder.hasCamera) {
+        std::cerr << filepath << ": there is no \"camera\"" << std::endl;
+        return false;
+    }
+
+    for (const char *section : { "materials", "lights", "objects" }) {
+        if (std::find(reader.sections.begin(), reader.sections.end(), section) == reader.sections.end()) {
+            std::cerr << filepath << ": there is no \"" << section << "\" array" << std::endl;
+            return false;
+        }
+    }
+
+    if (!builder.resolveMaterials(filepath))
+        return false;
+
+    if (!builder.loadMeshes(filepath, library, numThreads))
+        return false;
+
+    cameraParams = builder.cameraParams;
+    return true;
+}
+
+bool readCameraFile(const std::string &filepath, std::vector<std::pair<std::string, CameraParams>> &cameras) {
+    ElementReader reader(true, [&](ElementReader &reader, const std::string &, int index, const JsonRecord &element) {
+        CameraParams params;
+        if (!parseCamera(reader, element, params, nullptr))
+            return false;
+
+        std::string name = std::to_string(index);
+        if (reader.has(element, "name") && !reader.getString(element, "name", name))
+            return false;
+
+        cameras.push_back(std::make_pair(name, params));
+        return true;
+    });
+
+    return parseFile(filepath, reader);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "Scene.h"
+#include "MeshLibrary.h"
+
+// Scene files are read with the SAX Reader of rapidjson, straight from the
+// file a block at a time, instead of into a document of the whole file.
+// Every camera, material, light and object is collected on its own and
+// goes into the scene as soon as it ends, so memory does not grow with the
+// file beyond what the scene itself needs. Errors, in the JSON or in what
+// it describes, are printed with the file and line and make these return
+// false, whatever the build type
+
+// reads a scene file into scene. Objects may use materials defined after
+// them. The mesh files they refer to are read once the whole scene file
+// is, on numThreads threads, through library; one that cannot be read is
+// an error like any other. The camera is left to the
+// caller in cameraParams; its keyframes and those of the animated meshes
+// are added unsorted and the animated instances get no transform yet
+bool readSceneFile(const std::string &filepath,
+                   Scene &scene,
+                   MeshLibrary &library,
+                   int numThreads,
+                   CameraParams &cameraParams);
+
+// a JSON array of cameras, each named by its "name" or else its index
+bool readCameraFile(const std::string &filepath, std::vector<std::pair<std::string, CameraParams>> &cameras);
@@ -0,0 +1,91 @@
+#include "Stats.h"
+
+#include <mutex>
+#include <algorithm>
+
+static std::mutex totalsMutex;
+static Stats totalStats;
+
+Stats::Stats()
+        : counts{}
+        , inMesh{false} {}
+
+Stats &Stats::local() {
+    static thread_local Stats stats;
+    return stats;
+}
+
+void Stats::flush() {
+    Stats &stats = local();
+    std::lock_guard<std::mutex> lock(totalsMutex);
+
+    for (int k = 0; k < NUM_COUNTERS; k++) {
+        totalStats.counts[k] += stats.counts[k];
+        stats.counts[k] = 0;
+    }
+}
+
+Stats Stats::totals() {
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    return totalStats;
+}
+
+void Stats::resetTotals() {
+    std::lock_guard<std::mutex> lock(totalsMutex);
+    totalStats = Stats();
+}
+
+const char *Stats::name(Counter counter) {
+    switch (counter) {
+    case Counter::SceneNodes:        return "scene BVH nodes";
+    case Counter::SceneBoxRejects:   return "scene BVH box rejects";
+    case Counter::MeshNodes:         return "mesh BVH nodes";
+    case Counter::MeshBoxRejects:    return "mesh BVH box rejects";
+    case Counter::PlaneTests:        return "plane tests";
+    case Counter::SphereTests:       return "sphere tests";
+    case Counter::TriangleTests:     return "triangle tests";
+    case Counter::MeshTriangleTests: return "mesh triangle tests";
+    case Counter::Hits:              return "hits";
+    case Counter::Count:             break;
+    }
+
+    return "";
+}
+
+long long Stats::work() const {
+    const Stats &s = *this;
+
+    return s[Counter::SceneNodes] + s[Counter::MeshNodes]
+         + s[Counter::PlaneTests] + s[Counter::SphereTests]
+         + s[Counter::TriangleTests] + s[Counter::MeshTriangleTests];
+}
+
+std::vector<glm::vec4> heatmap(const std::vector<float> &costs) {
+    std::vector<glm::vec4> colors(costs.size(), glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    if (costs.empty())
+        return colors;
+
+    // a few very expensive pixels would leave everything else black
+    std::vector<float> sorted(costs);
+    size_t rank = (sorted.size() - 1) * 99 / 100;
+    std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+    float scale = sorted[rank] > 0.0f ? 1.0f / sorted[rank] : 0.0f;
+
+    for (size_t k = 0; k < costs.size(); k++) {
+        float x = std::min(1.0f, costs[k] * scale);
+
+        // black -> blue -> red -> yellow
+        glm::vec3 c;
+        if (x < 1.0f / 3.0f)
+            c = glm::vec3(0.0f, 0.0f, 3.0f * x);
+        else if (x < 2.0f / 3.0f)
+            c = glm::vec3(3.0f * x - 1.0f, 0.0f, 2.0f - 3.0f * x);
+        else
+            c = glm::vec3(1.0f, 3.0f * x - 2.0f, 0.0f);
+
+        colors[k] = glm::vec4(c, 1.0f);
+    }
+
+    return colors;
+}
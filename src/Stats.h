@@ -0,0 +1,84 @@
+#pragma once
+
+// Work counters for finding out where render time goes, compiled in with
+// the INSTRUMENT CMake option (SRT_INSTRUMENT). Every thread counts into
+// its own Stats, which the renderer merges into the totals after each
+// tile. Without SRT_INSTRUMENT the macros below expand to nothing, so the
+// hot paths are the same as without the counters.
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#ifdef SRT_INSTRUMENT
+static const bool STATS_ENABLED = true;
+#else
+static const bool STATS_ENABLED = false;
+#endif
+
+enum class Counter : int {
+    SceneNodes,         // BVH nodes of the scene whose box was tested
+    SceneBoxRejects,    // ... and missed
+    MeshNodes,          // the same in the BVHs of meshes
+    MeshBoxRejects,
+    PlaneTests,         // ray (or packet) against one object
+    SphereTests,
+    TriangleTests,
+    MeshTriangleTests,  // ray (or packet) against one triangle of a mesh
+    Hits,               // object tests that hit
+    Count
+};
+
+static const int NUM_COUNTERS = static_cast<int>(Counter::Count);
+
+struct Stats {
+    long long counts[NUM_COUNTERS];
+    bool inMesh;    // BVH nodes count as mesh nodes
+
+    Stats();
+
+    // the counters of the calling thread
+    static Stats &local();
+    // adds the counters of the calling thread to the totals and clears them
+    static void flush();
+    static Stats totals();
+    static void resetTotals();
+
+    static const char *name(Counter counter);
+
+    long long &operator[](Counter counter) { return counts[static_cast<int>(counter)]; }
+    long long operator[](Counter counter) const { return counts[static_cast<int>(counter)]; }
+
+    // cost used for the heatmap: nodes visited plus primitives tested
+    long long work() const;
+
+    // marks the BVH walks of a mesh for as long as it lives
+    struct MeshScope {
+        bool outer;
+        MeshScope() : outer{local().inMesh} { local().inMesh = true; }
+        ~MeshScope() { local().inMesh = outer; }
+    };
+};
+
+// cost per pixel to colors, from black (no work) over blue and red to
+// yellow at the 99th percentile of the costs and above
+std::vector<glm::vec4> heatmap(const std::vector<float> &costs);
+
+#ifdef SRT_INSTRUMENT
+#define SRT_COUNT(counter) (Stats::local()[Counter::counter]++)
+#define SRT_COUNT_N(counter, n) (Stats::local()[Counter::counter] += (n))
+// a box test of a BVH walk, mesh or scene depending on the scope
+#define SRT_COUNT_NODE(rejected)                                                               \
+    do {                                                                                       \
+        Stats &stats_ = Stats::local();                                                        \
+        stats_[stats_.inMesh ? Counter::MeshNodes : Counter::SceneNodes]++;                    \
+        if (rejected)                                                                          \
+            stats_[stats_.inMesh ? Counter::MeshBoxRejects : Counter::SceneBoxRejects]++;      \
+    } while (0)
+#define SRT_MESH_SCOPE() Stats::MeshScope meshScope_
+#else
+#define SRT_COUNT(counter) ((void)0)
+#define SRT_COUNT_N(counter, n) ((void)0)
+#define SRT_COUNT_NODE(rejected) ((void)0)
+#define SRT_MESH_SCOPE() ((void)0)
+#endif
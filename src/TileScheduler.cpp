@@ -0,0 +1,68 @@
+#include "TileScheduler.h"
+
+#include <algorithm>
+
+TileScheduler::TileScheduler(int width, int height, int tileSize) {
+    tiles.reserve(static_cast<size_t>((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize));
+
+    for (int y = 0; y < height; y += tileSize) {
+        for (int x = 0; x < width; x += tileSize) {
+            Tile tile;
+            tile.x0 = x;
+            tile.y0 = y;
+            tile.x1 = std::min(x + tileSize, width);
+            tile.y1 = std::min(y + tileSize, height);
+            tiles.push_back(tile);
+        }
+    }
+}
+
+int TileScheduler::numTiles() const {
+    return static_cast<int>(tiles.size());
+}
+
+bool TileScheduler::popLocal(WorkQueue &queue, int &tile) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.tiles.empty())
+        return false;
+
+    tile = queue.tiles.back();
+    queue.tiles.pop_back();
+    return true;
+}
+
+bool TileScheduler::steal(std::vector<WorkQueue> &queues, int thief, int &tile) {
+    int n = static_cast<int>(queues.size());
+
+    for (int k = 1; k < n; k++) {
+        WorkQueue &victim = queues[(thief + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.tiles.empty()) {
+            tile = victim.tiles.front();
+            victim.tiles.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void TileScheduler::run(WorkerPool &workers, const std::function<void(const Tile&)> &work) {
+    int numThreads = std::max(1, std::min(workers.size(), numTiles()));
+
+    // deal the tiles out in contiguous runs, neighbouring tiles tend to cost
+    // about the same, so stealing only kicks in where it pays off
+    std::vector<WorkQueue> queues(numThreads);
+    for (int i = 0; i < numTiles(); i++)
+        queues[static_cast<long long>(i) * numThreads / numTiles()].tiles.push_back(i);
+
+    // tiles never spawn more work, so a worker that finds every queue
+    // empty is done with this run
+    workers.run(numThreads, [&](int self) {
+        int tile;
+        while (popLocal(queues[self], tile) || steal(queues, self, tile))
+            work(tiles[tile]);
+    });
+}
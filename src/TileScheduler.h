@@ -0,0 +1,39 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <vector>
+#include <functional>
+
+#include "WorkerPool.h"
+
+struct Tile {
+    int x0, y0;  // inclusive
+    int x1, y1;  // exclusive
+};
+
+// splits the image into tiles and hands them to a pool of worker threads.
+// every worker owns a queue of tiles, and once it runs dry it steals from
+// the front of the other queues, so expensive tiles do not stall the pool.
+// The pool outlives the scheduler, one of them serves every pass and band
+class TileScheduler {
+private:
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<int> tiles;
+    };
+
+    std::vector<Tile> tiles;
+
+    bool popLocal(WorkQueue &queue, int &tile);
+    bool steal(std::vector<WorkQueue> &queues, int thief, int &tile);
+
+public:
+    TileScheduler(int width, int height, int tileSize);
+
+    int numTiles() const;
+
+    // calls work(tile) once for every tile, from the threads of workers
+    // (the calling thread being one of them)
+    void run(WorkerPool &workers, const std::function<void(const Tile&)> &work);
+};
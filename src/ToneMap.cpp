@@ -0,0 +1,60 @@
+#include "ToneMap.h"
+
+#include <cmath>
+
+#include "TileScheduler.h"
+
+// blocks handed to the threads, 40 for a 128 row band of a 1280 pixel
+// wide image
+static const int BLOCK_SIZE = 64;
+
+ToneMapping::ToneMapping()
+        : op{ToneOperator::Clamp}
+        , exposure{0.0f} {}
+
+bool ToneMapping::isIdentity() const {
+    return op == ToneOperator::Clamp && exposure == 0.0f;
+}
+
+glm::vec3 ToneMapping::apply(const glm::vec3 &c) const {
+    glm::vec3 x = c * std::exp2(exposure);
+
+    switch (op) {
+    case ToneOperator::Clamp:
+        return glm::clamp(x, 0.0f, 1.0f);
+    case ToneOperator::Reinhard:
+        x = glm::max(x, glm::vec3(0.0f));
+        return x / (x + 1.0f);
+    case ToneOperator::ACES:
+        x = glm::max(x, glm::vec3(0.0f));
+        return glm::clamp((x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f), 0.0f, 1.0f);
+    }
+
+    return x;
+}
+
+bool ToneMapping::parseOperator(const std::string &name, ToneOperator &op) {
+    if (name == "clamp")
+        op = ToneOperator::Clamp;
+    else if (name == "reinhard")
+        op = ToneOperator::Reinhard;
+    else if (name == "aces")
+        op = ToneOperator::ACES;
+    else
+        return false;
+
+    return true;
+}
+
+void toneMap(const ToneMapping &mapping, glm::vec4 *pixels, int width, int numRows, WorkerPool &workers) {
+    TileScheduler scheduler(width, numRows, BLOCK_SIZE);
+
+    scheduler.run(workers, [&](const Tile &tile) {
+        for (int y = tile.y0; y < tile.y1; y++) {
+            glm::vec4 *row = pixels + static_cast<size_t>(y) * width;
+
+            for (int x = tile.x0; x < tile.x1; x++)
+                row[x] = glm::vec4(mapping.apply(glm::vec3(row[x])), row[x].a);
+        }
+    });
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <string>
+
+#include "WorkerPool.h"
+
+#include <glm/glm.hpp>
+
+// how radiance is squeezed into [0, 1] before an image is stored with 8
+// bits per channel. Clamp cuts everything above 1 (what the PNG always
+// did), Reinhard maps x to x / (1 + x) and ACES is the filmic curve fit
+// by Narkowicz; all of them work on each channel after scaling it by
+// 2^exposure. Alpha is left as it is
+enum class ToneOperator { Clamp, Reinhard, ACES };
+
+struct ToneMapping {
+    ToneOperator op;
+    float exposure;     // in stops
+
+    ToneMapping();
+
+    // clamping at exposure 0 leaves every pixel as it is
+    bool isIdentity() const;
+
+    glm::vec3 apply(const glm::vec3 &c) const;
+
+    // "clamp", "reinhard" or "aces"
+    static bool parseOperator(const std::string &name, ToneOperator &op);
+};
+
+// tone maps numRows rows of width pixels in place, split into blocks
+// spread over the threads of workers
+void toneMap(const ToneMapping &mapping, glm::vec4 *pixels, int width, int numRows, WorkerPool &workers);
@@ -0,0 +1,409 @@
+#include "TriangleMesh.h"
+
+#include <cmath>
+#include <cctype>
+#include <limits>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+#include "MappedFile.h"
+
+// Helpers to parse the text of a mapped file in place. They skip leading
+// white space and comments ('#' to the end of the line) and leave p right
+// after what they read
+
+static void skipSpace(const char *&p, const char *end) {
+    while (p < end) {
+        if (*p == '#') {
+            while (p < end && *p != '\n')
+                p++;
+        } else if (std::isspace(static_cast<unsigned char>(*p))) {
+            p++;
+        } else {
+            break;
+        }
+    }
+}
+
+// rest of the current line, including the line break
+static void skipLine(const char *&p, const char *end) {
+    while (p < end && *p != '\n')
+        p++;
+    if (p < end)
+        p++;
+}
+
+static bool parseInt(const char *&p, const char *end, int &value) {
+    skipSpace(p, end);
+
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+        p++;
+
+    const char *first = p;
+    long long result = 0;
+
+    while (p < end && *p >= '0' && *p <= '9' && result <= INT_MAX) {
+        result = 10 * result + (*p - '0');
+        p++;
+    }
+
+    if (p == first || result > INT_MAX)
+        return false;
+
+    value = static_cast<int>(negative ? -result : result);
+    return true;
+}
+
+static bool parseFloat(const char *&p, const char *end, float &value) {
+    // powers of ten that are exact in a float
+    static const float POW10[] = {
+        1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f
+    };
+
+    skipSpace(p, end);
+    const char *first = p;
+
+    bool negative = p < end && *p == '-';
+    if (p < end && (*p == '-' || *p == '+'))
+        p++;
+
+    // decimal digits into mantissa * 10^exponent
+    unsigned long long mantissa = 0;
+    int exponent = 0;
+    int numDigits = 0;
+    int numSignificant = 0;
+
+    for (; p < end && *p >= '0' && *p <= '9'; p++, numDigits++) {
+        if (mantissa != 0 || *p != '0')
+            numSignificant++;
+        if (numSignificant <= 19)
+            mantissa = 10 * mantissa + (*p - '0');
+        else
+            exponent++;
+    }
+
+    if (p < end && *p == '.') {
+        for (p++; p < end && *p >= '0' && *p <= '9'; p++, numDigits++) {
+            if (mantissa != 0 || *p != '0')
+                numSignificant++;
+            if (numSignificant <= 19) {
+                mantissa = 10 * mantissa + (*p - '0');
+                exponent--;
+            }
+        }
+    }
+
+    if (numDigits > 0 && p < end && (*p == 'e' || *p == 'E')) {
+        const char *mark = p;
+        int e;
+
+        p++;
+        // an exponent is only taken when digits follow, as strtof does
+        if (p < end && (*p == '-' || *p == '+' || (*p >= '0' && *p <= '9')) && parseInt(p, end, e))
+            exponent += e;
+        else
+            p = mark;
+    }
+
+    // exact mantissa and power of ten: one IEEE multiply or divide rounds
+    // correctly, so this matches strtof (and so std::istream)
+    if (numDigits > 0 && numSignificant <= 19 && mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+        float result = static_cast<float>(mantissa);
+        result = exponent < 0 ? result / POW10[-exponent] : result * POW10[exponent];
+        value = negative ? -result : result;
+        return true;
+    }
+
+    // everything else (long mantissas, large exponents, inf, nan) goes
+    // through strtof on a null terminated copy of the token
+    p = first;
+    while (p < end && !std::isspace(static_cast<unsigned char>(*p)) && *p != '#')
+        p++;
+
+    char token[64];
+    size_t length = static_cast<size_t>(p - first);
+
+    if (length == 0 || length >= sizeof(token))
+        return false;
+
+    std::memcpy(token, first, length);
+    token[length] = '\0';
+
+    char *parsed;
+    value = std::strtof(token, &parsed);
+    return parsed == token + length;
+}
+
+TriangleMesh::TriangleMesh()
+        : bvh{} {}
+
+void TriangleMesh::buildTriangles(const std::vector<glm::vec3> &vertices, const std::vector<int> &indices) {
+    int numTriangles = static_cast<int>(indices.size() / 3);
+
+    triangles.resize(numTriangles);
+
+    for (int i = 0; i < numTriangles; i++) {
+        triangles.set(i,
+                      vertices[indices[3*i]],
+                      vertices[indices[3*i + 1]],
+                      vertices[indices[3*i + 2]]);
+    }
+}
+
+std::vector<AABB> TriangleMesh::triangleBounds() const {
+    std::vector<AABB> bounds(triangles.size());
+
+    for (int i = 0; i < triangles.size(); i++)
+        triangles.getBounds(i, bounds[i]);
+
+    return bounds;
+}
+
+void TriangleMesh::buildBVH() {
+    bvh.build(triangleBounds());
+
+    // store the triangles in leaf order, a leaf then covers a contiguous
+    // run of every array in triangles
+    triangles.reorder(bvh.takeLeafOrder());
+}
+
+bool TriangleMesh::readFromOFF(std::string filename) {
+    MappedFile file;
+
+    if (!file.open(filename))
+        return false;
+
+    const char *p = file.data();
+    const char *end = p + file.size();
+
+    skipSpace(p, end);
+
+    if (end - p < 3 || std::string(p, 3) != "OFF") {
+        std::cerr << "Invalid File format." << std::endl;
+        return false;
+    }
+
+    p += 3;
+
+    int nVertices, nFaces, nEdges;
+    if (!parseInt(p, end, nVertices) || !parseInt(p, end, nFaces) || !parseInt(p, end, nEdges) ||
+        nVertices < 0 || nFaces < 0) {
+        std::cerr << "Invalid OFF header in " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<glm::vec3> vertices;
+    std::vector<int> indices;
+
+    vertices.reserve(nVertices);
+    // exact for triangle meshes, n-gons grow it
+    indices.reserve(3 * static_cast<size_t>(nFaces));
+
+    // read vertices
+    for (int i = 0; i < nVertices; i++) {
+        float x, y, z;
+
+        if (!parseFloat(p, end, x) || !parseFloat(p, end, y) || !parseFloat(p, end, z)) {
+            std::cerr << "Invalid vertex " << i << " in " << filename << std::endl;
+            return false;
+        }
+
+        vertices.emplace_back(glm::vec3(x, y, z));
+    }
+
+    // read faces, an n-gon becomes a fan of n - 2 triangles around its first
+    // vertex. Anything after the indices (e.g. a color) is ignored. OFF faces
+    // are counter-clockwise seen from outside, the normal of a triangle is
+    // cross(c - a, b - a) (see TriangleArray::set), so every triangle is
+    // stored the other way round to have its normal point outwards
+    std::vector<int> face;
+
+    for (int j = 0; j < nFaces; j++) {
+        int n;
+
+        if (!parseInt(p, end, n) || n < 0) {
+            std::cerr << "Invalid face " << j << " in " << filename << std::endl;
+            return false;
+        }
+
+        face.resize(n);
+
+        for (int k = 0; k < n; k++) {
+            if (!parseInt(p, end, face[k]) || face[k] < 0 || face[k] >= nVertices) {
+                std::cerr << "Invalid vertex index in face " << j << " of " << filename << std::endl;
+                return false;
+            }
+        }
+
+        skipLine(p, end);
+
+        for (int k = 1; k + 1 < n; k++) {
+            indices.push_back(face[0]);
+            indices.push_back(face[k + 1]);
+            indices.push_back(face[k]);
+        }
+    }
+
+    // the file is not needed past this point
+    file.close();
+
+    buildTriangles(vertices, indices);
+    buildBVH();
+    mapping.reset();
+
+    return true;
+}
+
+bool TriangleMesh::getBounds(AABB &box) const {
+    if (bvh.empty())
+        return false;
+
+    box = bvh.nodeData()[0].bounds;
+    return true;
+}
+
+bool TriangleMesh::intersect(const glm::vec3 &e,
+                             const glm::vec3 &d,
+                             float t0,
+                             float &t,
+                             int &prim) const {
+
+    SRT_MESH_SCOPE();
+
+    int nearest = -1;
+    float min_t = std::numeric_limits<float>::infinity();
+
+    auto record = [&](int i, float this_t, float &tMax) {
+        if (this_t < min_t || (this_t == min_t && nearest > i)) {
+            min_t = this_t;
+            nearest = i;
+            tMax = this_t;
+        }
+    };
+
+    // a leaf is a contiguous run of triangles, with SIMD the whole run is
+    // tested at once (one triangle per lane)
+    auto test = [&](int first, int count, float &tMax) {
+        SRT_COUNT_N(MeshTriangleTests, count);
+
+        if (!PACKET_SIMD) {
+            for (int i = first; i < first + count; i++) {
+                float this_t;
+                if (triangles.intersect(i, e, d, t0, this_t))
+                    record(i, this_t, tMax);
+            }
+            return false;
+        }
+
+        for (int begin = first; begin < first + count; begin += PACKET_WIDTH) {
+            PacketFloat tLanes;
+            float lanes[PACKET_WIDTH];
+
+            int n = std::min(PACKET_WIDTH, first + count - begin);
+            int hits = triangles.intersectRange(begin, n, e, d, t0, tLanes);
+
+            if (hits == 0)
+                continue;
+
+            tLanes.store(lanes);
+            for (int k = 0; k < n; k++) {
+                if ((hits >> k) & 1)
+                    record(begin + k, lanes[k], tMax);
+            }
+        }
+        return false;
+    };
+
+    bvh.traverseLeaves(e, d, t0, min_t, test);
+
+    if (nearest < 0)
+        return false;
+
+    t = min_t;
+    prim = nearest;
+    return true;
+}
+
+void TriangleMesh::intersect(const RayPacket &rays, float t0, PacketHit &meshHits) const {
+    SRT_MESH_SCOPE();
+
+    meshHits.t = std::numeric_limits<float>::infinity();
+    for (int i = 0; i < PACKET_WIDTH; i++)
+        meshHits.idx[i] = -1;
+
+    // the triangles are in leaf order, a leaf is a run of them
+    auto test = [&](int first, int count) {
+        for (int i = first; i < first + count; i++) {
+            SRT_COUNT(MeshTriangleTests);
+
+            PacketFloat t;
+            PacketMask mask = triangles.intersect(i, rays, t0, t);
+
+            if (mask.any())
+                meshHits.update(mask, t, i);
+        }
+    };
+
+    bvh.traversePacketLeaves(rays, t0, meshHits.t, test);
+}
+
+bool TriangleMesh::occluded(const glm::vec3 &e,
+                            const glm::vec3 &d,
+                            float t0,
+                            float t1,
+                            int &prim) const {
+
+    SRT_MESH_SCOPE();
+
+    // stops at the first leaf with a hit in range, which triangle that is
+    // does not matter. tMax is the end of the range the walk still searches
+    auto test = [&](int first, int count, float &tMax) {
+        for (int begin = first; begin < first + count; begin += PACKET_WIDTH) {
+            int n = std::min(PACKET_WIDTH, first + count - begin);
+            SRT_COUNT_N(MeshTriangleTests, n);
+
+            if (!triangles.occludedRange(begin, n, e, d, t0, tMax))
+                continue;
+
+            for (int i = begin; i < begin + n; i++) {
+                if (triangles.occluded(i, e, d, t0, tMax)) {
+                    prim = i;
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+
+    return bvh.traverseLeaves(e, d, t0, t1, test);
+}
+
+bool TriangleMesh::occluded(int prim,
+                            const glm::vec3 &e,
+                            const glm::vec3 &d,
+                            float t0,
+                            float t1) const {
+
+    if (prim >= triangles.size())
+        return false;
+
+    // the box the tree was built (or refit) from, see triangleBounds()
+    AABB box;
+    triangles.getBounds(prim, box);
+
+    glm::vec3 invD(1.0f / d.x, 1.0f / d.y, 1.0f / d.z);
+
+    if (!box.intersectRay(e, invD, t0, t1))
+        return false;
+
+    SRT_COUNT(MeshTriangleTests);
+
+    return triangles.occluded(prim, e, d, t0, t1);
+}
+
+glm::vec3 TriangleMesh::normal(int prim) const {
+    return triangles.normal(prim);
+}
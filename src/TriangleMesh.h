@@ -0,0 +1,46 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "BVH.h"
+#include "Packet.h"
+#include "MappedFile.h"
+#include "Primitives.h"
+
+#include <glm/glm.hpp>
+
+class TriangleMesh {
+private:
+    BVH bvh;  // over triangles, the root box bounds the whole mesh
+    // the cache that triangles and the BVH are attached to, if they were
+    // read from one (shared by copies of the mesh)
+    std::shared_ptr<const MappedFile> mapping;
+
+    std::vector<AABB> triangleBounds() const;
+    void buildTriangles(const std::vector<glm::vec3> &vertices, const std::vector<int> &indices);
+    void buildBVH();
+
+    friend class MeshCache;
+
+public:
+    TriangleArray triangles;  // in the space of the mesh, stored in BVH leaf order
+
+    TriangleMesh();
+
+    bool readFromOFF(std::string filename);
+    bool getBounds(AABB &box) const;
+
+    // nearest triangle hit beyond t0, ties go to the lower triangle
+    bool intersect(const glm::vec3 &e, const glm::vec3 &d, float t0, float &t, int &prim) const;
+    // the same for every lane, meshHits.idx gets the triangle (-1 on a miss)
+    void intersect(const RayPacket &rays, float t0, PacketHit &meshHits) const;
+    // true on the first triangle found with a hit in (t0, t1), prim gets it
+    bool occluded(const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, int &prim) const;
+    // the same with the hit in range being triangle prim, when the BVH walk
+    // would reach it
+    bool occluded(int prim, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) const;
+    glm::vec3 normal(int prim) const;
+};
@@ -0,0 +1,76 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(int numThreads)
+        : job{nullptr}
+        , round{0}
+        , numActive{0}
+        , numBusy{0}
+        , stopping{false} {
+
+    for (int t = 1; t < numThreads; t++)
+        threads.emplace_back(&WorkerPool::loop, this, t);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (unsigned t = 0; t < threads.size(); t++)
+        threads[t].join();
+}
+
+int WorkerPool::size() const {
+    return static_cast<int>(threads.size()) + 1;
+}
+
+void WorkerPool::loop(int self) {
+    unsigned long long seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for (;;) {
+        wake.wait(lock, [&] { return stopping || round != seen; });
+        if (stopping)
+            return;
+
+        // a thread the job does not need sits it out, run only waits for
+        // the ones that take part, so none of them misses its round
+        seen = round;
+        if (self >= numActive)
+            continue;
+
+        const std::function<void(int)> &work = *job;
+        lock.unlock();
+        work(self);
+        lock.lock();
+
+        if (--numBusy == 0)
+            done.notify_one();
+    }
+}
+
+void WorkerPool::run(int numThreads, const std::function<void(int)> &work) {
+    numThreads = std::max(1, std::min(numThreads, size()));
+
+    if (numThreads > 1) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &work;
+            numActive = numThreads;
+            numBusy = numThreads - 1;
+            round++;
+        }
+        wake.notify_all();
+    }
+
+    work(0);
+
+    if (numThreads > 1) {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&] { return numBusy == 0; });
+    }
+}
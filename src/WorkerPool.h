@@ -0,0 +1,43 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+// threads that stay alive from one job to the next. Everything a thread
+// keeps in thread_local storage (occluders, scratch buffers, counters)
+// is built once for the whole render instead of again for every pass,
+// band and tone mapped block
+class WorkerPool {
+private:
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable wake;   // a new job or the end
+    std::condition_variable done;   // the last worker finished the job
+
+    const std::function<void(int)> *job;
+    unsigned long long round;       // bumped for every job
+    int numActive;                  // threads of the current job
+    int numBusy;                    // ... still working on it, besides the caller
+    bool stopping;
+
+    void loop(int self);
+
+public:
+    // numThreads including the thread calling run
+    explicit WorkerPool(int numThreads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool &operator=(const WorkerPool&) = delete;
+
+    int size() const;
+
+    // calls job(t) once on each of the first numThreads threads of the pool
+    // (t = 0 is the calling thread) and returns once all of them are done.
+    // Not to be called from inside a job
+    void run(int numThreads, const std::function<void(int)> &job);
+};
@@ -1,9 +1,13 @@
 // C++ include
-#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
+#include <cstdio>
+#include <thread>
 #include <cstddef>
+#include <cstdlib>
 #include <iostream>
+#include <algorithm>
 
 // Image writing library
 #define STB_IMAGE_WRITE_IMPLEMENTATION
@@ -11,214 +15,415 @@
 #include "utils.h"
 
 #include "Scene.h"
+#include "Stats.h"
+#include "ToneMap.h"
+#include "Renderer.h"
+#include "ImageWriter.h"
 
 #include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-
-static int MAXRECURSION = 3;
-static float EPSILON = 1e-4f;
-static float FLOAT_INF = std::numeric_limits<float>::infinity();
-
-struct HitRecord {
-    int idx;
-    float t;
-    float phong;
-
-    glm::vec3 n;
-    glm::vec3 ka;
-    glm::vec3 kd;
-    glm::vec3 ks;
-    glm::vec3 km;
-};
 
 // hlper functions to do simple string processing
-static std::string getDirname(std::string filepath);
 static std::string getFileName(std::string filepath);
 
-// returns true if the ray hits any object when t is in [t0, t1]
-static bool findIntersections(const std::vector<Object3D*> objs, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1);
-// compute the color of a pixel using Blinn-Phong Shading
-static glm::vec3 raycolor(const Scene &scene, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, int recursionDepth);
-// find the nearest intersection and record necessary info to compute color
-static bool findNearestIntersection(const Scene &scene, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, HitRecord &rec);
-
-int main(int argc, char *argv[]) {
-    Scene scene;
-    std::vector<glm::vec4> pixels;
+// the first progressive pass traces one pixel in 8x8
+static const int PROGRESSIVE_STEP = 8;
+// rows rendered (and held in memory) at a time when streaming the image
+static const int BAND_ROWS = 128;
+
+struct RenderOptions {
+    int numThreads;
+    bool packetTracing;
+    bool progressive;
+    bool wavefront;
+    float minThroughput;
+    float lightCutoff;
+    float lightError;
+    int aaSamples;
+    int width;      // 0: from height and the ratio of the camera
+    int height;     // 0: from width, 720 if neither is given
+    int bandRows;
+    ImageFormat format;
+    bool hdr;       // a PFM next to the image
+    bool aovs;      // and one with coverage, depth and object ids
+    ToneMapping toneMapping;
+};
 
-    std::string jsonPath = argc <= 1
-                           ? "../data/sphere-and-plane.json"
-                           : std::string(argv[1]);
+static void printUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [--threads N] [--aa N] [--no-packets] [--no-mesh-cache] [--progressive] [--wavefront] [--min-throughput X] [--light-cutoff X] [--light-error X] [--width W] [--height H] [--format png|ppm|raw|pfm] [--hdr] [--aov] [--tonemap clamp|reinhard|aces] [--exposure E] [--band-rows N] [--cameras <path-to-JSON-file>] [--frames FIRST:LAST|all] [<path-to-JSON-or-PFM-file>...]" << std::endl;
+}
 
-    if (!scene.loadSceneFromJSON(jsonPath)) {
-        std::cerr << "Failed to load scene from JSON" << std::endl;
-        return -1;
+// "FIRST:LAST", or "all" for every frame between the keyframes of a scene
+// (first = last = -1 here)
+static bool parseFrames(const std::string &arg, int &first, int &last) {
+    if (arg == "all") {
+        first = last = -1;
+        return true;
     }
 
-    const std::string filename = getFileName(jsonPath) + ".png";
-    std::cout << "Rendering scene defined in " << jsonPath << std::endl;
+    char rest;
+    return std::sscanf(arg.c_str(), "%d:%d%c", &first, &last, &rest) == 2 && first >= 0 && first <= last;
+}
 
-    Camera3D& camera = scene.camera;
-    std::vector<Object3D*> &objects = scene.objects;
+static std::string frameSuffix(int frame) {
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "-%04d", frame);
+    return suffix;
+}
 
-    glm::vec3 e = camera.getPosition();
+// the files of one image: <name>.<format>, tone mapped unless the format
+// is HDR, with --hdr also <name>.pfm as rendered, and with --aov
+// <name>-aov.pfm holding coverage, depth and object id (-1 for none) in
+// its red, green and blue channels
+class ImageOutput {
+private:
+    const RenderOptions &options;
+    WorkerPool &workers;        // tone map the rows
+    std::unique_ptr<ImageWriter> image;
+    std::unique_ptr<ImageWriter> hdr;
+    std::unique_ptr<ImageWriter> aov;
+    std::vector<glm::vec4> mapped;
+
+public:
+    const std::string filename;
+    const std::string hdrFilename;
+    const std::string aovFilename;
+
+    ImageOutput(const std::string &name, const RenderOptions &options, WorkerPool &workers)
+            : options(options)
+            , workers(workers)
+            , filename{name + ImageWriter::extension(options.format)}
+            , hdrFilename{options.hdr && options.format != ImageFormat::PFM ? name + ".pfm" : ""}
+            , aovFilename{options.aovs ? name + "-aov.pfm" : ""} {}
+
+    bool open(int width, int height) {
+        image = ImageWriter::create(options.format);
+        if (!image->open(filename, width, height))
+            return false;
+
+        if (!hdrFilename.empty()) {
+            hdr = ImageWriter::create(ImageFormat::PFM);
+            if (!hdr->open(hdrFilename, width, height))
+                return false;
+        }
 
-    glm::mat4 inv_view = glm::inverse(camera.getViewMatrix());
-    glm::mat4 inv_proj = glm::inverse(camera.getProjectionMatrix());
+        if (!aovFilename.empty()) {
+            aov = ImageWriter::create(ImageFormat::PFM);
+            if (!aov->open(aovFilename, width, height))
+                return false;
+        }
 
-    int IMAGE_HEIGHT = 720;
-    int IMAGE_WIDTH = static_cast<int>(camera.getRatio() * IMAGE_HEIGHT);
+        return true;
+    }
 
-    for (int j = 0; j < IMAGE_HEIGHT; j++) {
-        for (int i = 0; i < IMAGE_WIDTH; i++) {
-            glm::vec4 p_clip = {
-                2.0f * (float)i/(float)IMAGE_WIDTH - 1.0f,
-                1.0f - 2.0f * (float)j/(float)IMAGE_HEIGHT,
-                -1.0f,
-                1.0f
-            };
+    // the AOVs of the rows just written
+    bool writeAOVs(const AOVBuffers &aovs, int width, int numRows) {
+        if (!aov)
+            return true;
 
-            glm::vec4 p_eye = inv_proj * p_clip;
-            p_eye = glm::vec4(p_eye.x, p_eye.y, -1.0f, 0.0f);
+        mapped.resize(static_cast<size_t>(width) * numRows);
+        for (size_t k = 0; k < mapped.size(); k++)
+            mapped[k] = glm::vec4(aovs.coverage[k], aovs.depth[k], static_cast<float>(aovs.objectId[k]), 1.0f);
 
-            glm::vec3 d = glm::normalize(glm::vec3(inv_view * p_eye));
+        return aov->writeRows(mapped.data(), numRows);
+    }
 
-            glm::vec3 L = raycolor(scene, e, d, camera.getFocalLength(), FLOAT_INF, 1);
+    bool writeRows(const glm::vec4 *pixels, int width, int numRows) {
+        bool written = !hdr || hdr->writeRows(pixels, numRows);
 
-            if (findIntersections(objects, e, d, camera.getFocalLength(), FLOAT_INF))
-                pixels.push_back(glm::vec4(L, 1.0f));
-            else
-                pixels.push_back(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
-        } // each col
-    } // each row
+        if (ImageWriter::isHDR(options.format) || options.toneMapping.isIdentity())
+            return image->writeRows(pixels, numRows) && written;
 
-    write_matrix_to_png(pixels, IMAGE_HEIGHT, IMAGE_WIDTH, filename);
-    std::cout << "Image written to " << filename << std::endl;
-}
+        // the rendered pixels stay as they are for the PFM
+        mapped.assign(pixels, pixels + static_cast<size_t>(width) * numRows);
+        toneMap(options.toneMapping, mapped.data(), width, numRows, workers);
+        return image->writeRows(mapped.data(), numRows) && written;
+    }
 
-static std::string getDirname(std::string filepath) {
-    #if defined(WIN32) || defined(_WIN32)
-        std::size_t slash = filepath.find("\\");
-        while (slash != std::string::npos) {
-            filepath.replace(slash, 1, "/");
-            slash = filepath.find("\\");
-        }
-    #endif
+    bool close() {
+        bool closed = !hdr || hdr->close();
+        closed = (!aov || aov->close()) && closed;
+        return image->close() && closed;
+    }
+};
 
-    std::size_t pos = filepath.find_last_of("/");
+// writes the tone mapped image of the PFM at path to <name>.<format>
+static bool toneMapFile(const std::string &path, const RenderOptions &options, WorkerPool &workers) {
+    if (ImageWriter::isHDR(options.format)) {
+        std::cerr << "Tone mapping " << path << " needs an 8 bit --format" << std::endl;
+        return false;
+    }
 
-    if (pos == std::string::npos)
-        return "";
+    std::vector<glm::vec4> pixels;
+    int width, height;
+    if (!readPFM(path, pixels, width, height))
+        return false;
+
+    RenderOptions imageOptions = options;
+    imageOptions.hdr = false;
+    imageOptions.aovs = false;
+
+    ImageOutput output(getFileName(path), imageOptions, workers);
+    if (!output.open(width, height) || !output.writeRows(pixels.data(), width, height) || !output.close())
+        return false;
 
-    return filepath.substr(0, pos);
+    std::cout << "Tone mapped " << path << " to " << output.filename << std::endl;
+    return true;
 }
 
-static std::string getFileName(std::string filepath) {
-    #if defined(WIN32) || defined(_WIN32)
-        std::size_t slash = filepath.find("\\");
-        while (slash != std::string::npos) {
-            filepath.replace(slash, 1, "/");
-            slash = filepath.find("\\");
-        }
-    #endif
+// renders the current camera of scene to <name>.<format>
+static bool renderScene(Scene &scene, const std::string &name, const RenderOptions &options, WorkerPool &workers) {
+    ImageOutput output(name, options, workers);
+    const std::string &filename = output.filename;
+    float ratio = scene.camera.getRatio();
+
+    int IMAGE_HEIGHT = options.height > 0 ? options.height
+                     : options.width > 0 ? std::max(1, static_cast<int>(options.width / ratio))
+                     : 720;
+    int IMAGE_WIDTH = options.width > 0 ? options.width : static_cast<int>(ratio * IMAGE_HEIGHT);
+
+    Renderer renderer(scene, IMAGE_WIDTH, IMAGE_HEIGHT);
+    renderer.setPacketTracing(options.packetTracing);
+    renderer.setAntialiasing(options.aaSamples);
+    renderer.setWavefront(options.wavefront, options.minThroughput);
+    renderer.setLightCulling(options.lightCutoff, options.lightError);
+    renderer.setAOVs(options.aovs);
+
+    if (STATS_ENABLED)
+        Stats::resetTotals();
+
+    long long numRays;
+
+    if (options.progressive) {
+        std::vector<glm::vec4> pixels;
+
+        // the image is rewritten after every pass, so it can be watched
+        // and the render stopped once it looks good enough
+        numRays = renderer.renderProgressive(pixels, workers, PROGRESSIVE_STEP, [&](int pass, int numPasses) {
+            if (output.open(IMAGE_WIDTH, IMAGE_HEIGHT)) {
+                output.writeRows(pixels.data(), IMAGE_WIDTH, IMAGE_HEIGHT);
+                output.writeAOVs(renderer.aovs(), IMAGE_WIDTH, IMAGE_HEIGHT);
+            }
+            output.close();
+
+            std::cout << "Pass " << pass + 1 << "/" << numPasses
+                      << " written to " << filename << std::endl;
+        });
+    } else {
+        // every band goes to the file as soon as it is done, so the whole
+        // image is never in memory
+        if (!output.open(IMAGE_WIDTH, IMAGE_HEIGHT))
+            return false;
+
+        bool written = true;
+        numRays = renderer.renderBands(workers, options.bandRows, [&](int y0, int y1, const std::vector<glm::vec4> &band) {
+            written = output.writeRows(band.data(), IMAGE_WIDTH, y1 - y0) && written;
+            written = output.writeAOVs(renderer.aovs(), IMAGE_WIDTH, y1 - y0) && written;
+        });
+
+        if (!output.close() || !written)
+            return false;
+
+        std::cout << "Image written to " << filename << std::endl;
+        if (!output.hdrFilename.empty())
+            std::cout << "HDR image written to " << output.hdrFilename << std::endl;
+        if (!output.aovFilename.empty())
+            std::cout << "AOVs written to " << output.aovFilename << std::endl;
+    }
 
-    std::size_t pos1 = filepath.find_last_of("/");
-    std::size_t pos2 = filepath.find_last_of(".");
+    if (options.aaSamples > 1) {
+        std::cout << "Average samples per pixel: "
+                  << static_cast<double>(numRays) / (static_cast<double>(IMAGE_WIDTH) * IMAGE_HEIGHT) << std::endl;
+    }
 
-    if (pos1 == std::string::npos || pos2 == std::string::npos)
-        return "";
+    if (STATS_ENABLED) {
+        RayCounts rays = renderer.rayCounts();
+        Stats totals = Stats::totals();
 
-    return filepath.substr(pos1 + 1, pos2 - (pos1 + 1));
-}
+        std::cout << "primary rays: " << rays.primary << std::endl;
+        std::cout << "shadow rays: " << rays.shadow << std::endl;
+        std::cout << "reflection rays: " << rays.reflection << std::endl;
 
-static bool findNearestIntersection(const Scene &scene, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, HitRecord &rec) {
-
-    bool intersected = false;
-    const std::vector<Object3D*> &objs = scene.objects;
-    float min_t = std::numeric_limits<float>::infinity();
-
-    for (int i = 0; i < objs.size(); i++) {
-        float this_t;
-        glm::vec3 this_n;
-        bool this_bool = objs[i]->intersectRay(e, d, this_t, this_n);
-
-        if (this_bool && t0 < this_t && this_t < t1 && this_t < min_t) {
-            min_t = this_t;
-            intersected = true;
-
-            rec.idx = i;
-            rec.t = this_t;
-            rec.n = this_n;
-            rec.ka = objs[i]->material->ka;
-            rec.kd = objs[i]->material->kd;
-            rec.ks = objs[i]->material->ks;
-            rec.km = objs[i]->material->km;
-            rec.phong = objs[i]->material->shiness;
-        }
+        for (int k = 0; k < NUM_COUNTERS; k++)
+            std::cout << Stats::name(static_cast<Counter>(k)) << ": " << totals.counts[k] << std::endl;
+
+        const std::string heatmapName = name + "-heatmap.png";
+        write_matrix_to_png(heatmap(renderer.pixelCosts()), IMAGE_HEIGHT, IMAGE_WIDTH, heatmapName);
+        std::cout << "Cost heatmap written to " << heatmapName << std::endl;
     }
 
-    return intersected;
+    return true;
 }
 
-static bool findIntersections(const std::vector<Object3D*> objs, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1) {
-    for (int k = 0; k < objs.size(); k++) {
-        float this_t;
-        glm::vec3 this_n;
-        bool this_bool = objs[k]->intersectRay(e, d, this_t, this_n);
-
-        if (this_bool && t0 < this_t && this_t < t1)
-            return true;
+int main(int argc, char *argv[]) {
+    std::vector<std::string> jsonPaths;
+    std::string camerasPath;
+    bool useMeshCache = true;
+    bool animate = false;
+    int firstFrame = 0, lastFrame = 0;
+
+    RenderOptions options;
+    options.numThreads = std::max(1u, std::thread::hardware_concurrency());
+    options.packetTracing = PACKET_SIMD;
+    options.progressive = false;
+    options.wavefront = false;
+    options.minThroughput = 0.0f;
+    options.lightCutoff = 0.0f;
+    options.lightError = DEFAULT_LIGHT_ERROR;
+    options.aaSamples = 1;
+    options.width = 0;
+    options.height = 0;
+    options.bandRows = BAND_ROWS;
+    options.format = ImageFormat::PNG;
+    options.hdr = false;
+    options.aovs = false;
+
+    for (int k = 1; k < argc; k++) {
+        std::string arg = argv[k];
+
+        if (arg == "--threads" && k + 1 < argc) {
+            options.numThreads = std::max(1, std::atoi(argv[++k]));
+        } else if (arg == "--aa" && k + 1 < argc) {
+            options.aaSamples = std::max(1, std::atoi(argv[++k]));
+        } else if (arg == "--no-packets") {
+            options.packetTracing = false;
+        } else if (arg == "--no-mesh-cache") {
+            useMeshCache = false;
+        } else if (arg == "--progressive") {
+            options.progressive = true;
+        } else if (arg == "--wavefront") {
+            options.wavefront = true;
+        } else if (arg == "--min-throughput" && k + 1 < argc) {
+            options.minThroughput = static_cast<float>(std::atof(argv[++k]));
+        } else if (arg == "--light-cutoff" && k + 1 < argc) {
+            options.lightCutoff = static_cast<float>(std::atof(argv[++k]));
+        } else if (arg == "--light-error" && k + 1 < argc) {
+            options.lightError = static_cast<float>(std::atof(argv[++k]));
+        } else if (arg == "--width" && k + 1 < argc) {
+            options.width = std::max(0, std::atoi(argv[++k]));
+        } else if (arg == "--height" && k + 1 < argc) {
+            options.height = std::max(0, std::atoi(argv[++k]));
+        } else if (arg == "--band-rows" && k + 1 < argc) {
+            options.bandRows = std::max(1, std::atoi(argv[++k]));
+        } else if (arg == "--format" && k + 1 < argc) {
+            if (!ImageWriter::parseFormat(argv[++k], options.format)) {
+                printUsage(argv[0]);
+                return -1;
+            }
+        } else if (arg == "--hdr") {
+            options.hdr = true;
+        } else if (arg == "--aov") {
+            options.aovs = true;
+        } else if (arg == "--tonemap" && k + 1 < argc) {
+            if (!ToneMapping::parseOperator(argv[++k], options.toneMapping.op)) {
+                printUsage(argv[0]);
+                return -1;
+            }
+        } else if (arg == "--exposure" && k + 1 < argc) {
+            options.toneMapping.exposure = static_cast<float>(std::atof(argv[++k]));
+        } else if (arg == "--cameras" && k + 1 < argc) {
+            camerasPath = argv[++k];
+        } else if (arg == "--frames" && k + 1 < argc) {
+            if (!parseFrames(argv[++k], firstFrame, lastFrame)) {
+                printUsage(argv[0]);
+                return -1;
+            }
+            animate = true;
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            printUsage(argv[0]);
+            return -1;
+        } else {
+            jsonPaths.push_back(arg);
+        }
     }
 
-    return false;
-}
+    if (jsonPaths.empty())
+        jsonPaths.push_back("../data/sphere-and-plane.json");
 
-static glm::vec3 raycolor(const Scene &scene, const glm::vec3 &e, const glm::vec3 &d, float t0, float t1, int recursionDepth) {
-    HitRecord rec;
-    glm::vec3 color(0.0f, 0.0f, 0.0f);
+    std::vector<std::pair<std::string, Camera3D>> cameras;
+    if (!camerasPath.empty() && !Scene::loadCamerasFromJSON(camerasPath, cameras)) {
+        std::cerr << "Failed to load cameras from JSON" << std::endl;
+        return -1;
+    }
 
-    const std::vector<Light> &lights = scene.lights;
-    const std::vector<Object3D*> &objects = scene.objects;
+    // every scene of the batch gets its meshes from here, a mesh used by
+    // several of them is read and gets its BVH only once
+    MeshLibrary meshLibrary;
+    // and is rendered and tone mapped by the same threads
+    WorkerPool workers(options.numThreads);
+    int failed = 0;
+
+    for (const std::string &jsonPath : jsonPaths) {
+        // a saved HDR render only gets tone mapped again
+        if (jsonPath.size() > 4 && jsonPath.compare(jsonPath.size() - 4, 4, ".pfm") == 0) {
+            failed += !toneMapFile(jsonPath, options, workers);
+            continue;
+        }
 
-    bool intersected = findNearestIntersection(scene, e, d, t0, t1, rec);
+        // nothing the previous scene left on the threads carries over
+        workers.run(workers.size(), [](int) {
+            Renderer::releaseThreadCaches();
+        });
 
-    if (intersected) {
-        glm::vec3 hit = e + rec.t * d;
-        glm::vec3 adjustedHit = hit + EPSILON * rec.n;
+        Scene scene;
+        scene.useMeshCache = useMeshCache;
+        scene.meshLibrary = &meshLibrary;
+        scene.numLoadThreads = options.numThreads;
 
-        for (int j = 0; j < lights.size(); j++) {
-            glm::vec3 l(0.0f);
-            if (lights[j].type == LightType::Point)
-                l = glm::normalize(lights[j].position - hit);
-            else if (lights[j].type == LightType::Directional)
-                l = glm::normalize(-1.0f * lights[j].direction);
+        if (!scene.loadSceneFromJSON(jsonPath)) {
+            std::cerr << "Failed to load scene from " << jsonPath << std::endl;
+            failed++;
+            continue;
+        }
 
-            float tMax = 0.0f;
-            if (lights[j].type == LightType::Point)
-                tMax = glm::length(lights[j].position - hit);
-            else if (lights[j].type == LightType::Directional)
-                tMax = FLOAT_INF;
+        std::cout << "Rendering scene defined in " << jsonPath
+                  << " on " << options.numThreads << " thread(s)" << std::endl;
 
-            color += rec.ka * lights[j].ambient;
+        // without --frames only what the scene shows on load (frame 0)
+        int first = firstFrame, last = lastFrame;
+        if (first < 0 && !scene.frameRange(first, last))
+            first = last = 0;
 
-            if (!findIntersections(objects, adjustedHit, l, 0.0f, tMax)) {
-                glm::vec3 v = glm::normalize(e - hit);
-                glm::vec3 h = glm::normalize(v + l);
+        for (int frame = first; frame <= last; frame++) {
+            const std::string suffix = animate ? frameSuffix(frame) : "";
 
-                float diff = std::max(0.0f, glm::dot(rec.n, l));
-                glm::vec3 diffuse = lights[j].diffuse * (diff * rec.kd);
+            // only instances that move get new transforms
+            scene.setFrame(static_cast<float>(frame));
 
-                float spec = pow(std::max(0.0f, glm::dot(rec.n, h)), rec.phong);
-                glm::vec3 specular = lights[j].specular * (spec * rec.ks);
+            if (cameras.empty()) {
+                failed += !renderScene(scene, getFileName(jsonPath) + suffix, options, workers);
+                continue;
+            }
 
-                color += diffuse + specular;
+            for (const auto &camera : cameras) {
+                scene.camera = camera.second;
+                failed += !renderScene(scene, getFileName(jsonPath) + "-" + camera.first + suffix, options, workers);
             }
         }
+    }
+
+    if (jsonPaths.size() > 1)
+        std::cout << "Meshes loaded for the batch: " << meshLibrary.size() << std::endl;
 
-        if (recursionDepth < MAXRECURSION) {
-            glm::vec3 r = glm::reflect(d, rec.n);
-            color += rec.km * raycolor(scene, adjustedHit, r, 0.0f, FLOAT_INF, recursionDepth + 1);
+    return failed == 0 ? 0 : -1;
+}
+
+static std::string getFileName(std::string filepath) {
+    #if defined(WIN32) || defined(_WIN32)
+        std::size_t slash = filepath.find("\\");
+        while (slash != std::string::npos) {
+            filepath.replace(slash, 1, "/");
+            slash = filepath.find("\\");
         }
-    }
-    return color;
-}
\ No newline at end of file
+    #endif
+
+    std::size_t pos1 = filepath.find_last_of("/");
+    std::size_t pos2 = filepath.find_last_of(".");
+
+    // no directory: the name starts at the beginning
+    std::size_t start = pos1 == std::string::npos ? 0 : pos1 + 1;
+
+    if (pos2 == std::string::npos || pos2 < start)
+        return "";
+
+    return filepath.substr(start, pos2 - start);
+}
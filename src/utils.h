@@ -19,8 +19,8 @@ void write_matrix_to_png(const std::vector<glm::vec4> &pixels, int numRows, int
 
     std::vector<unsigned char> data(w*h*comp,0);
 
-    for (int wi = 0; wi < w; ++wi) {
-        for (int hi = 0; hi < h; ++hi) {
+    for (int hi = 0; hi < h; ++hi) {
+        for (int wi = 0; wi < w; ++wi) {
             const glm::vec4 &p = pixels[hi*w+wi];
             data[(hi * w * 4) + (wi * 4) + 0] = floatToUnsignedChar(p.r);
             data[(hi * w * 4) + (wi * 4) + 1] = floatToUnsignedChar(p.g);